@@ -13,11 +13,53 @@
  // インクルード
  // ============================================================================
 #define _USE_MATH_DEFINES
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE      // 合成スレッドのコア固定 (pthread_setaffinity_np)
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
 #include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <windows.h>     // ファイルのメモリマップ (CreateFileMapping)
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#if defined(__linux__)
+#include <pthread.h>
+#endif
+#endif
+#include <GL/glew.h>     // VBO/VAOなどGL 1.5以降の関数の取得 (glut.hより先にインクルードする)
 #include <GL/glut.h>
+#if defined(_WIN32)
+#include <GL/wglew.h>    // 垂直同期の設定 (wglSwapIntervalEXT)
+#endif
+
+// SIMD音声合成カーネル用の組み込み関数
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIANO_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(_M_ARM64) || defined(__ARM_NEON)
+#define PIANO_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC/Clangでは命令セットを関数単位で有効化する (MSVCは指定不要)
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_SSE2
+#define SIMD_TARGET_AVX2
+#endif
 
 // miniaudioライブラリの実装を有効化
 #define MINIAUDIO_IMPLEMENTATION
@@ -29,11 +71,40 @@
 // ============================================================================
 
 // --- オーディオ関連 ---
-#define AUDIO_SAMPLE_RATE       44100
+#define AUDIO_SAMPLE_RATE       44100   // 既定のサンプルレート (--sample-rate で変更可)
+#define AUDIO_SAMPLE_RATE_MIN   8000
+#define AUDIO_SAMPLE_RATE_MAX   192000
+#define AUDIO_PERIOD_FRAMES_MAX 8192
+#define AUDIO_PERIOD_COUNT_MAX  8
+#define DEVICE_TEST_DEFAULT_S   3.0     // --device-test の既定の再生時間
+#define DEVICE_TEST_NOTE_MS     250     // --device-test で打鍵・離鍵を繰り返す間隔
+#define DEVICE_TEST_POLL_MS     10
 #define AUDIO_ATTACK_TIME_S     0.01
 #define AUDIO_RELEASE_TIME_S    0.01
+#define VOICE_STEAL_FADE_TIME_S 0.005   // 上限を超えて奪われたボイスのフェードアウト時間
+#define VOICE_POOL_SIZE         64      // 事前確保するボイス数 (奪われてフェード中のボイスもここに含む)
+#define DEFAULT_MAX_POLYPHONY   32      // 同時発音数の既定値 (--polyphony で 1〜VOICE_POOL_SIZE に変更可)
+#define MIDI_NOTE_COUNT         128
+#define RENDER_THREAD_MAX       8       // audio_callback 自身を含む音声合成スレッド数の上限 (--render-threads)
+#define RENDER_PARALLEL_MIN_VOICES 8    // これより発音数が少なければ分割せずに合成する (受け渡しの方が高くつく)
+#define RENDER_SPIN_LIMIT       4096    // 待ちのスピン回数がこれを超えたらOSにCPUを譲る
+#define RENDER_AHEAD_MAX_MS     500     // --render-ahead で指定できる先行合成量の上限
+#define RENDER_AHEAD_CHUNK_FRAMES 256   // 先行合成スレッドが1回に合成するフレーム数
+#define RENDER_AHEAD_PREFILL_TIMEOUT_MS 2000 // 開始前にリングバッファが満たされるまで待つ上限
 #define MIDI_NOTE_A4            69
 #define FREQUENCY_A4            440.0f
+#define WAVETABLE_SIZE          2048
+#define WAVETABLE_OCTAVE_COUNT  11      // MIDIノート0〜131を1オクターブ単位でカバー
+#define AUDIO_RENDER_BLOCK_FRAMES 256
+#define AUDIO_KERNEL_TOLERANCE  1.0e-4f
+#define AUDIO_EVENT_QUEUE_SIZE  256     // 2のべき乗
+#define OFFLINE_RENDER_CHUNK_FRAMES 4096
+#define BENCHMARK_DURATION_S    2.0     // 各測定条件で描画する音声の長さ
+#define BENCHMARK_MAX_BUFFER_FRAMES 4096
+#define RENDER_CHECK_VOICES     32      // --thread-check で鳴らす和音の音数
+#define RENDER_CHECK_HELD_VOICES 4      // 後半も鳴らし続ける音数 (分割しない経路への切り替えも通す)
+#define RENDER_CHECK_DURATION_S 1.0
+#define AUDIO_TIMING_HISTOGRAM_BINS 11  // 時間予算の使用率10%刻み + 100%超過
 
 // --- ピアノ・UI関連 ---
 #define PIANO_KEY_COUNT         37
@@ -49,18 +120,58 @@
 #define MOUSE_SENSITIVITY       0.1f
 #define CAMERA_PITCH_MAX        89.0f
 #define CAMERA_PITCH_MIN       -89.0f
+#define CAMERA_FOV_Y_DEG        45.0    // 垂直画角 (投影行列と視錐台カリングで共有する)
+#define CAMERA_NEAR_PLANE       0.1
+#define CAMERA_FAR_PLANE        150.0
 
 // --- アニメーション・描画関連 ---
 #define ANIMATION_TIMER_MS      16
-#define KEY_ANIMATION_SPEED     0.2f
+#define FRAME_MIN_INTERVAL_MS   16      // 再描画の最短間隔 (約60FPSを上限とする)
+#define KEY_ANIMATION_SPEED     0.2f    // 基準間隔 (KEY_ANIMATION_REFERENCE_S) あたりに目標位置へ近づく割合
+#define KEY_ANIMATION_REFERENCE_S 0.016
+#define ANIMATION_STEP_S        (1.0 / 120.0)   // アニメーションの固定更新間隔
+#define ANIMATION_MAX_CATCHUP_S 0.25            // 長時間停止後に一度に進める時間の上限
 #define RETICLE_SIZE            10
 #define HUD_MARGIN_X            10
 #define HUD_MARGIN_Y            30
 #define HUD_LINE_HEIGHT         20
+#define HUD_REFRESH_MS          500     // 音声統計表示の更新間隔 (鍵盤が止まっていても動かし続ける)
+#define HUD_GLYPH_FIRST         32      // フォントアトラスに焼き込む文字 (ASCIIの表示可能文字)
+#define HUD_GLYPH_LAST          126
+#define HUD_ATLAS_COLUMNS       16
+#define HUD_ATLAS_ROWS          6       // 95文字 + 塗りつぶしセル1つ
+#define HUD_GLYPH_CELL_SIZE     24      // 1文字分のセルの大きさ (ピクセル)
+#define HUD_GLYPH_BASELINE      6       // セル下端からベースラインまでの高さ (下に伸びる文字の分)
+#define HUD_MAX_LINES           16
+#define HUD_LINE_MAX_CHARS      96
+#define HUD_MAX_VERTICES        ((HUD_MAX_LINES * HUD_LINE_MAX_CHARS + 2) * 6)  // 文字 + レティクル2本
+#define KEY_INSTANCE_ATTRIB_LOCATION 1  // 0は gl_Vertex と共有されるドライバがあるため避ける
+
+// --- シーンオブジェクト・BVH関連 ---
+#define SCENE_OBJECT_MAX        (PIANO_KEY_COUNT + TIMBRE_BUTTON_COUNT + OCTAVE_BUTTON_COUNT)
+#define BVH_NODE_MAX            (SCENE_OBJECT_MAX * 2)
+#define BVH_LEAF_OBJECT_COUNT   2
+
+// --- ファイル読み込み関連 ---
+#define FILE_PATH_MAX           260
+#define TEXTURE_MAX_ANISOTROPY  8.0f    // 異方性フィルタリングに対応していれば床の斜め方向のぼやけを抑える
+#define MESH_CACHE_EXTENSION    ".meshcache"    // OBJファイル名の後ろに付けてキャッシュファイル名とする
+#define MESH_CACHE_MAGIC        0x48534D50u     // "PMSH"
+#define MESH_CACHE_VERSION      2
+#define MATERIAL_NAME_MAX       64
+
+// --- 非同期アセット読み込み関連 ---
+#define ASSET_LOADER_THREAD_COUNT 4
+#define ASSET_JOB_MAX           16
+#define LOADING_POLL_MS         16      // 読み込み完了を確認し、GLへ転送する間隔
+#define LOADING_BAR_WIDTH       300
+#define LOADING_BAR_HEIGHT      8
+#define SEQUENCE_DEFAULT_TEMPO  120.0f
 
 // --- メニューID ---
 #define MENU_ID_SEQ_PLAY        1
 #define MENU_ID_SEQ_STOP        2
+#define MENU_ID_ALL_NOTES_OFF   3
 
 
 // ============================================================================
@@ -88,11 +199,157 @@ typedef struct {
     vector_3d_t max;
 } bounding_box_t;
 
+// VBOに格納するインターリーブ形式の頂点
 typedef struct {
-    GLuint display_list_id;
+    float position[3];
+    float normal[3];
+    float tex_coord[2];
+} mesh_vertex_t;
+
+// コンパイル済みメッシュキャッシュのヘッダー。直後に頂点配列、インデックス配列、マテリアル範囲が続き、そのままVBOへ転送できる
+typedef struct {
+    ma_uint32 magic;
+    ma_uint32 version;
+    ma_uint64 source_size;          // 元のOBJファイルのサイズ・更新時刻・内容のハッシュ
+    ma_int64 source_mtime;
+    ma_uint64 source_hash;
+    ma_uint32 vertex_count;
+    ma_uint32 index_count;
+    ma_uint32 vertex_size;          // sizeof(mesh_vertex_t) (頂点形式が変わったキャッシュを無効にする)
+    ma_uint32 submesh_count;        // インデックス配列の後に model_submesh_t が続く
+    bounding_box_t local_bbox;
+} mesh_cache_header_t;
+
+// 読み取り専用でメモリマップしたファイル
+typedef struct {
+    const unsigned char* data;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE file_handle;
+    HANDLE mapping_handle;
+#else
+    int file_descriptor;
+#endif
+} mapped_file_t;
+
+// 選択・カリングの対象となるオブジェクトの種類
+typedef enum {
+    SCENE_OBJECT_KEY,
+    SCENE_OBJECT_TIMBRE_BUTTON,
+    SCENE_OBJECT_OCTAVE_BUTTON,
+    SCENE_OBJECT_TYPE_COUNT
+} scene_object_type_e;
+
+typedef struct {
+    scene_object_type_e type;
+    int index;                  // 種類ごとの配列 (g_piano_keys など) のインデックス
+    bounding_box_t world_bbox;
+} scene_object_t;
+
+// 静的BVHのノード。葉は g_bvh_object_order の first_object から object_count 個のオブジェクトを持つ
+typedef struct {
+    bounding_box_t bbox;
+    int left_child;             // 葉なら -1
+    int right_child;
+    int first_object;
+    int object_count;
+} bvh_node_t;
+
+typedef struct {
+    int object_index;           // g_scene_objects のインデックス (-1 = なし)
+    double distance;            // カメラからの距離
+} pick_result_t;
+
+// OBJの usemtl で指定され、.mtl ファイルで定義されるマテリアル
+typedef struct {
+    char name[MATERIAL_NAME_MAX];
+    GLfloat ambient[4];
+    GLfloat diffuse[4];
+    GLfloat specular[4];
+    GLfloat shininess;
+} model_material_t;
+
+// 同じマテリアルの三角形をまとめたインデックスバッファ内の範囲
+typedef struct {
+    model_material_t material;
+    GLsizei first_index;
+    GLsizei index_count;
+} model_submesh_t;
+
+typedef struct {
+    GLuint vertex_array_id;     // VAO非対応の環境では0
+    GLuint vertex_buffer_id;
+    GLuint index_buffer_id;
+    GLsizei index_count;
     bounding_box_t local_bbox;
+    model_submesh_t* submeshes; // マテリアルごとの範囲 (インデックスはマテリアル順に並べてある)
+    int submesh_count;
 } model_3d_t;
 
+// GLへ転送する前のメッシュ (ワーカースレッドで作成し、メインスレッドで転送する)
+typedef struct {
+    const mesh_vertex_t* vertices;
+    int vertex_count;
+    const GLuint* indices;
+    int index_count;
+    model_submesh_t* submeshes;     // 転送時に model_3d_t へ引き渡す
+    int submesh_count;
+    bounding_box_t local_bbox;
+    mapped_file_t cache_file;       // キャッシュから読んだ場合、頂点・インデックスはこのマップ内を指す
+} mesh_data_t;
+
+// GLへ転送する前のテクスチャ画像 (8bit、RGBまたはグレースケール)
+typedef struct {
+    const unsigned char* pixels;    // バイナリ形式 (P6/P5, 最大値255) はマップしたファイル内を直接指す
+    int width;
+    int height;
+    int channel_count;              // 3 = RGB (P6/P3), 1 = グレースケール (P5/P2)
+    unsigned char* converted_pixels;    // テキスト形式や最大値が255以外の場合だけ変換先として確保する
+    mapped_file_t file;
+} image_data_t;
+
+typedef enum {
+    ASSET_TYPE_TIMBRE,
+    ASSET_TYPE_SEQUENCE,
+    ASSET_TYPE_MODEL,
+    ASSET_TYPE_TEXTURE
+} asset_type_e;
+
+// 起動時に読み込むファイル1つ分の仕事。解析はワーカースレッド、GLへの転送はメインスレッドで行う
+typedef struct {
+    asset_type_e type;
+    const char* filename;
+    int timbre_index;
+    model_3d_t* model;              // 転送先 (ASSET_TYPE_MODEL)
+    GLuint* texture;                // 転送先 (ASSET_TYPE_TEXTURE)
+    mesh_data_t mesh;
+    image_data_t image;
+    int is_loaded;
+    int is_uploaded;                // メインスレッドのみが参照する
+    MA_ATOMIC(4, ma_uint32) is_finished;    // ワーカーが書き込み (release)、メインスレッドが読み取る (acquire)
+} asset_job_t;
+
+// OBJ解析中のデータ。配列は要素数が容量に達するたびに2倍に拡張する
+typedef struct {
+    float (*positions)[3];
+    int position_count, position_capacity;
+    float (*normals)[3];
+    int normal_count, normal_capacity;
+    float (*tex_coords)[2];
+    int tex_coord_count, tex_coord_capacity;
+    int (*corners)[3];              // 三角形分割後の各頂点の v/vt/vn (1始まり、0は省略)
+    int corner_count, corner_capacity;
+    int* triangle_materials;        // 三角形ごとの materials のインデックス (-1 = マテリアルなし)
+    int triangle_capacity;
+    model_material_t* materials;
+    int material_count, material_capacity;
+    int current_material;
+    int face_count;
+    int malformed_line_count;
+    int is_out_of_memory;
+    bounding_box_t bbox;
+} obj_parse_state_t;
+
 typedef struct {
     float amplitude;
     float phase_shift;
@@ -102,24 +359,165 @@ typedef struct {
     char name[64];
     int harmonic_count;
     harmonic_t* harmonics;
+    float* wavetables;      // オクターブ帯域ごとの帯域制限済み波形 (各 WAVETABLE_SIZE + 1 サンプル)
 } timbre_t;
 
 typedef struct {
     key_type_e type;
     int midi_note;
     float center_pos[3];
-    envelope_state_e envelope_state;
-    double wave_phase;
-    double current_amplitude;
     float current_y_pos;
+    float previous_y_pos;       // 1ステップ前の位置 (描画時の補間用)
     float target_y_pos;
+    int is_animating;           // アニメーション中の鍵盤一覧に登録済みか
 } piano_key_t;
 
+// 発音中の1音。鍵盤とは独立にボイスプールから割り当てるため、同じノートの再打鍵も重ねて鳴らせる
+typedef struct {
+    int midi_note;
+    envelope_state_e envelope_state;
+    double wave_phase;          // 1周期を1.0とした正規化位相
+    double current_amplitude;
+    double release_decrement;   // リリース中の1フレームあたりの減衰量 (奪われたボイスは短いフェードになる)
+    ma_uint64 start_order;      // 発音順の通し番号 (最も古いボイスを奪うため)
+    int is_stolen;              // 新しいノートに奪われてフェードアウト中 (同時発音数に数えない)
+} voice_t;
+
 typedef struct {
     int midi_note;
     float duration_ms;
 } sequence_event_t;
 
+typedef enum {
+    AUDIO_EVENT_NOTE_ON,
+    AUDIO_EVENT_NOTE_OFF,
+    AUDIO_EVENT_SET_TIMBRE,
+    AUDIO_EVENT_SET_OCTAVE,
+    AUDIO_EVENT_SEQ_START,
+    AUDIO_EVENT_SEQ_STOP,
+    AUDIO_EVENT_ALL_NOTES_OFF,  // 押鍵中のボイスをすべてリリースへ移す (発音中のボイスだけを走査する)
+    AUDIO_EVENT_SEQ_FINISHED    // オーディオスレッド → UIスレッド (value: 1=最後まで再生, 0=停止)
+} audio_event_type_e;
+
+typedef struct {
+    audio_event_type_e type;
+    int value;                  // MIDIノート番号・音色番号・オクターブシフト
+    ma_uint64 frame_time;       // 適用するオーディオフレーム時刻 (過去の時刻ならブロックの先頭で適用)
+    double post_time_s;         // 送った時刻 (入力から合成までの遅延の計測用)
+} audio_event_t;
+
+// オーディオデバイスの設定 (0 はバックエンドの既定値を使う)
+typedef struct {
+    ma_uint32 sample_rate;
+    ma_uint32 period_frames;
+    ma_uint32 period_count;
+    ma_performance_profile performance_profile;
+    ma_backend backend;
+    int has_backend;            // 0 = miniaudio がバックエンドを自動選択する
+} audio_config_t;
+
+// 単一生産者・単一消費者のロックフリーリングバッファ
+typedef struct {
+    audio_event_t events[AUDIO_EVENT_QUEUE_SIZE];
+    MA_ATOMIC(4, ma_uint32) write_index;
+    MA_ATOMIC(4, ma_uint32) read_index;
+} audio_event_queue_t;
+
+// オーディオスレッド内で動くシーケンサーの状態
+typedef struct {
+    int is_playing;
+    int event_index;
+    int sounding_note;              // 直前のイベントで鳴らしたノート (0=なし)
+    double next_event_time;         // 次イベントの理想発音時刻 (フレーム単位の小数)
+    int fired_event_count;
+    double total_error_frames;      // 実際の発音フレームと理想時刻との差の累計 (絶対値)
+    double max_error_frames;
+} sequencer_state_t;
+
+// audio_callback の処理時間統計 (オーディオスレッドのみが書き込み、UIスレッドは読み取るだけ)
+// 先行合成中も callback_count 〜 histogram はデバイスのコールバック (リングバッファからの読み出し) を数える
+typedef struct {
+    MA_ATOMIC(8, ma_uint64) callback_count;
+    MA_ATOMIC(8, ma_uint64) xrun_count;             // 処理時間が時間予算を超えたコールバック数
+    MA_ATOMIC(8, ma_uint64) total_duration_ns;
+    MA_ATOMIC(8, ma_uint64) total_budget_ns;
+    MA_ATOMIC(4, ma_uint32) last_duration_ns;
+    MA_ATOMIC(4, ma_uint32) last_budget_ns;
+    MA_ATOMIC(4, ma_uint32) max_duration_ns;
+    MA_ATOMIC(4, ma_uint32) histogram[AUDIO_TIMING_HISTOGRAM_BINS];
+    // 先行合成モードだけで使う (デバイスのコールバックが書き込む)
+    MA_ATOMIC(8, ma_uint64) underrun_count;         // リングバッファが足りず無音で埋めたコールバック数
+    MA_ATOMIC(4, ma_uint32) last_fill_frames;       // コールバック開始時にリングバッファにあったフレーム数
+    MA_ATOMIC(4, ma_uint32) min_fill_frames;
+    // 先行合成スレッドの1チャンクごとの合成時間 (合成スレッドが書き込む)
+    MA_ATOMIC(8, ma_uint64) chunk_count;
+    MA_ATOMIC(8, ma_uint64) chunk_overrun_count;    // 合成時間がチャンクの再生時間を超えた回数
+    MA_ATOMIC(8, ma_uint64) total_chunk_duration_ns;
+    MA_ATOMIC(8, ma_uint64) total_chunk_budget_ns;
+    MA_ATOMIC(4, ma_uint32) max_chunk_duration_ns;
+    // UIスレッドが打鍵イベントを送ってから合成スレッドが適用するまでの時間
+    MA_ATOMIC(8, ma_uint64) input_latency_count;
+    MA_ATOMIC(8, ma_uint64) total_input_latency_ns;
+    MA_ATOMIC(4, ma_uint32) max_input_latency_ns;
+} audio_timing_stats_t;
+
+// HUDの頂点 (フォントアトラスを張った四角形を2つの三角形で描く)
+typedef struct {
+    float position[2];
+    float tex_coord[2];
+    GLubyte color[4];
+} hud_vertex_t;
+
+// HUDに表示する音声統計のスナップショット (表示更新の間隔ごとに取り込む)
+typedef struct {
+    ma_uint64 callback_count;
+    ma_uint64 xrun_count;
+    ma_uint32 last_duration_ns;
+    ma_uint32 last_budget_ns;
+    ma_uint32 max_duration_ns;
+    ma_uint32 histogram[AUDIO_TIMING_HISTOGRAM_BINS];
+    ma_uint64 underrun_count;
+    ma_uint32 last_fill_frames;
+    ma_uint32 min_fill_frames;
+    ma_uint32 chunk_load_permille;      // 先行合成スレッドの平均使用率 (0.1% 単位)
+    ma_uint64 chunk_overrun_count;
+    ma_uint32 mean_input_latency_ns;
+    ma_uint32 max_input_latency_ns;
+} hud_audio_stats_t;
+
+// HUDの表示内容を決める状態。前回と memcmp で比較し、変化した時だけ頂点バッファを作り直す
+typedef struct {
+    hud_audio_stats_t audio_stats;
+    int window_width;
+    int window_height;
+    int octave_shift;
+    int timbre_index;
+    int is_sequencer_playing;
+    int is_loading_assets;
+    int loaded_asset_count;
+    int asset_count;
+} hud_state_t;
+
+// audio_callback が合成ワーカーへ渡すブロック単位の仕事
+typedef struct {
+    const timbre_t* timbre;
+    int octave_shift;
+    int block_frames;
+    int partition_count;        // ボイスを分ける数 (ワーカー数 + audio_callback 自身)
+} render_job_t;
+
+// 発音中ボイス一覧のうち partition_index 番目から partition_count 個おきのボイスを担当し、専用のバッファへ合成する
+typedef struct {
+    ma_thread thread;
+    int partition_index;
+    ma_uint32 last_generation;  // 最後に処理した世代 (起動が遅れても最初の仕事を取りこぼさないよう作成前に設定する)
+    float mix_buffer[AUDIO_RENDER_BLOCK_FRAMES];
+} render_worker_t;
+
+// 1ボイス分の波形に線形ゲインランプ (gain + gain_step * i) を掛けてミックスバッファへ加算する合成カーネル
+typedef void (*voice_render_kernel_t)(float* mix_buffer, const float* table, double* phase, double phase_increment,
+    float gain, float gain_step, int frame_count);
+
 
 // ============================================================================
 // グローバル変数
@@ -137,9 +535,11 @@ GLuint g_texture_wood;
 
 // --- ピアノ・音色 ---
 piano_key_t g_piano_keys[PIANO_KEY_COUNT];
+int g_note_keys[MIDI_NOTE_COUNT];   // ノート番号 → g_piano_keysのインデックス (-1=鍵盤なし)
 timbre_t g_timbres[TIMBRE_BUTTON_COUNT];
-int g_current_timbre_index = 0;
+int g_current_timbre_index = 0;     // UIスレッド側の設定値 (オーディオスレッドへはイベントで通知)
 int g_current_octave_shift = 0;
+int g_mouse_held_note = 0;          // マウスで押している鍵盤のノート (0=なし)
 
 // --- カメラ ---
 float g_camera_pos[] = { -3.5f, 17.0f, -17.0f };
@@ -150,12 +550,105 @@ float g_camera_pitch = -45.0f;
 
 // --- オーディオデバイス ---
 ma_device g_audio_device;
+ma_context g_audio_context;             // バックエンドを指定した場合だけ使う
+int g_is_audio_context_initialized = 0;
+audio_config_t g_audio_config = { AUDIO_SAMPLE_RATE, 0, 0, ma_performance_profile_low_latency, ma_backend_null, 0 };
+double g_output_latency_ms = 0.0;       // 合成してから発音されるまでの出力側の遅延の推定値 (デバイス開始後にバッファサイズから求める)
+double g_event_wait_ms = 0.0;           // 打鍵イベントが次の合成まで待つ最大時間 (デバイスの1周期)
+int g_is_audio_started = 0;             // 音色の読み込みが終わった時点で開始する
+
+// --- 非同期アセット読み込み ---
+asset_job_t g_asset_jobs[ASSET_JOB_MAX];
+int g_asset_job_count = 0;
+MA_ATOMIC(4, ma_uint32) g_next_asset_job = 0;  // ワーカーが次に取り出す仕事の番号
+ma_thread g_asset_loader_threads[ASSET_LOADER_THREAD_COUNT];
+int g_asset_loader_thread_count = 0;    // 0ならメインスレッドで1つずつ読み込む
+int g_is_loading_assets = 0;
+int g_loaded_asset_count = 0;
+double g_loading_start_time_s = 0.0;
+
+// --- 時刻 (音声計測・フレーム制御で共用する単調増加クロック) ---
+ma_timer g_monotonic_timer;
+
+// --- ウィンドウ (on_reshape で更新し、描画・入力処理はこの値を使う) ---
+int g_window_width = 1;
+int g_window_height = 1;
+
+// --- HUD (文字はフォントアトラスから描き、表示内容が変わった時だけ頂点を作り直す) ---
+GLuint g_hud_font_texture = 0;                  // 初回の描画時にGLUTのビットマップフォントから作成する
+int g_hud_glyph_advances[HUD_GLYPH_LAST - HUD_GLYPH_FIRST + 1];
+GLuint g_hud_vertex_buffer_id = 0;
+int g_hud_vertex_count = 0;
+hud_state_t g_hud_state;                        // 頂点バッファに反映済みの状態
+int g_is_hud_state_valid = 0;
+hud_audio_stats_t g_hud_audio_stats;            // UIスレッドで取り込んだ直近の音声統計
+
+// --- 描画フレーム制御 ---
+int g_is_frame_scheduled = 0;           // 再描画要求をまとめて次のフレーム時刻に1回だけ描画する
+double g_last_frame_time_s = -1.0;
+int g_is_animation_timer_running = 0;   // 動いている鍵盤もシーケンサー再生も無ければタイマーを止める
+
+// --- 鍵盤アニメーション (固定ステップで更新し、描画時に補間する) ---
+int g_animating_keys[PIANO_KEY_COUNT];  // 動いている鍵盤のg_piano_keysのインデックス
+int g_animating_key_count = 0;
+double g_animation_time_s = 0.0;        // 最後にシミュレーションを進めた時刻
+double g_animation_accumulator_s = 0.0; // まだ進めていない経過時間 (ANIMATION_STEP_S 未満)
+
+// --- オーディオ計測 ---
+audio_timing_stats_t g_audio_timing_stats;
+const char* g_audio_stats_filename = NULL;  // 終了時に統計を書き出すCSVファイル (--audio-stats)
+
+// --- 音声合成カーネル (起動時にCPU機能から選択) ---
+voice_render_kernel_t g_render_voice_kernel = NULL;
+const char* g_render_voice_kernel_name = "Scalar";
+float g_mix_buffer[AUDIO_RENDER_BLOCK_FRAMES];
+
+// --- UIスレッドからオーディオスレッドへのイベント ---
+audio_event_queue_t g_audio_event_queue;
+audio_event_queue_t g_ui_event_queue;               // オーディオスレッドからUIスレッドへの鍵盤・シーケンサー通知
+MA_ATOMIC(8, ma_uint64) g_audio_frame_clock = 0;    // 合成済みフレーム数 (オーディオスレッドのみ更新)
+
+// --- オーディオスレッド専用状態 (ボイスのエンベロープ・位相もこのスレッドのみが更新する) ---
+voice_t g_voices[VOICE_POOL_SIZE];
+int g_free_voices[VOICE_POOL_SIZE];     // 未使用のg_voicesのインデックス (スタック)
+int g_free_voice_count = 0;
+int g_active_voices[VOICE_POOL_SIZE];   // 発音中のg_voicesのインデックス
+int g_active_voice_count = 0;
+int g_note_voices[MIDI_NOTE_COUNT];     // ノート番号 → 押鍵中のボイス (-1=なし)
+ma_uint64 g_voice_start_counter = 0;
+int g_max_polyphony = DEFAULT_MAX_POLYPHONY;
+int g_audio_timbre_index = 0;
+int g_audio_octave_shift = 0;
+
+// --- 並列音声合成 (ブロックごとに世代番号を進めて配り、終了数を数えて待つ) ---
+int g_render_thread_count = 1;                      // --render-threads で指定された合成スレッド数
+int g_is_render_thread_count_forced = 0;            // 1ならコア数による制限を外す (--thread-check)
+int g_is_synthesis_thread_pinned = 0;               // 合成を受け持つスレッド (コールバックまたは先行合成) をコア0に固定したか
+render_worker_t g_render_workers[RENDER_THREAD_MAX - 1];
+int g_render_worker_count = 0;                      // 起動済みのワーカー数 (0=audio_callback だけで合成)
+render_job_t g_render_job;
+ma_semaphore g_render_wake_semaphore;               // コールバックの最初の分配で1回だけワーカーを起こす
+MA_ATOMIC(4, ma_uint32) g_render_generation = 0;
+MA_ATOMIC(4, ma_uint32) g_render_finished_count = 0;
+MA_ATOMIC(4, ma_uint32) g_is_render_session_active = 0; // コールバック中はワーカーがスピンして次のブロックを待つ
+MA_ATOMIC(4, ma_uint32) g_is_render_shutdown = 0;
+
+// --- 先行合成 (合成スレッドがリングバッファへ先に書き、デバイスのコールバックは写すだけ) ---
+int g_render_ahead_ms = 0;                          // --render-ahead で指定された先行量 (0=コールバック内で直接合成)
+ma_uint32 g_render_ahead_frames = 0;                // 起動中の先行量 (フレーム数)
+MA_ATOMIC(4, ma_uint32) g_render_ahead_fill_target = 0; // 合成スレッドが保つ残量 (開始前だけリングバッファ全体)
+ma_pcm_rb g_render_ahead_buffer;
+ma_event g_render_ahead_event;                      // デバイスが読み出すたびに合成スレッドを起こす
+ma_thread g_render_ahead_thread;
+MA_ATOMIC(4, ma_uint32) g_is_render_ahead_running = 0;
+MA_ATOMIC(4, ma_uint32) g_is_render_ahead_shutdown = 0;
+MA_ATOMIC(4, ma_uint32) g_is_render_ahead_exited = 0;  // 合成スレッドが (停止要求以外の理由でも) 終了した
 
 // --- シーケンサー ---
 sequence_event_t* g_sequence = NULL;
 int g_sequence_length = 0;
-int g_sequence_index = 0;
-int g_is_sequencer_playing = 0;
+int g_is_sequencer_playing = 0;         // UIスレッド側の再生状態 (HUD表示用)
+sequencer_state_t g_sequencer;          // オーディオスレッド側の再生状態
 
 // --- オブジェクト配置座標 (定数) ---
 const float WHITE_KEY_X_START = 7.0f;
@@ -173,6 +666,56 @@ const float OCTAVE_BUTTON_POSITIONS[][4] = {
     {5.0f, 0.8f, 3.5f,  90.0f}
 };
 
+// --- シーンオブジェクト (選択・カリング・ホバー表示の対象、起動時に構築) ---
+scene_object_t g_scene_objects[SCENE_OBJECT_MAX];
+int g_scene_object_count = 0;
+int g_scene_object_first[SCENE_OBJECT_TYPE_COUNT];  // 種類ごとの先頭インデックス (同じ種類は連続して登録する)
+bvh_node_t g_bvh_nodes[BVH_NODE_MAX];
+int g_bvh_node_count = 0;
+int g_bvh_object_order[SCENE_OBJECT_MAX];
+int g_bvh_sort_axis = 0;                            // qsort の比較関数に渡す分割軸
+int g_is_scene_object_visible[SCENE_OBJECT_MAX];    // 直近のフレームの視錐台カリング結果
+int g_hovered_scene_object = -1;                    // レティクルが指しているオブジェクト
+
+// --- 鍵盤のインスタンス描画 ---
+GLuint g_key_shader_program = 0;                // 0ならglCallList相当の1鍵盤ずつの描画に戻る
+GLuint g_key_instance_buffer_id = 0;            // 鍵盤ごとの位置 (center_pos + 補間した鍵盤の高さ)
+int g_key_instance_order[PIANO_KEY_COUNT];      // 白鍵、黒鍵の順に並べたg_piano_keysのインデックス
+int g_white_key_count = 0;
+int g_visible_white_key_count = 0;              // インスタンスバッファには視錐台内の鍵盤だけを詰めて格納する
+int g_visible_black_key_count = 0;
+int g_are_key_instances_dirty = 1;              // 位置・表示・ホバー状態が変わったらバッファを更新する
+GLint g_key_hover_emission_location = -1;
+
+// 固定機能パイプラインと同じ頂点単位のライティング (GL_LIGHT0 + glMaterial) を行う
+const char* KEY_VERTEX_SHADER_SOURCE =
+    "#version 120\n"
+    "attribute vec4 instance_offset;  // xyz: 鍵盤位置, w: ホバー強調 (0 or 1)\n"
+    "uniform vec3 hover_emission;\n"
+    "varying vec4 lit_color;\n"
+    "void main() {\n"
+    "    vec4 eye_position = gl_ModelViewMatrix * (gl_Vertex + vec4(instance_offset.xyz, 0.0));\n"
+    "    vec3 normal = normalize(gl_NormalMatrix * gl_Normal);\n"
+    "    vec4 light_position = gl_LightSource[0].position;\n"
+    "    vec3 light_dir = normalize(light_position.xyz - eye_position.xyz * light_position.w);\n"
+    "    vec3 half_vector = normalize(light_dir + vec3(0.0, 0.0, 1.0));\n"
+    "    float diffuse = max(dot(normal, light_dir), 0.0);\n"
+    "    vec4 color = gl_FrontLightModelProduct.sceneColor + gl_FrontLightProduct[0].ambient + gl_FrontLightProduct[0].diffuse * diffuse;\n"
+    "    if (diffuse > 0.0) {\n"
+    "        color += gl_FrontLightProduct[0].specular * pow(max(dot(normal, half_vector), 0.0), gl_FrontMaterial.shininess);\n"
+    "    }\n"
+    "    color.rgb += hover_emission * instance_offset.w;\n"
+    "    lit_color = vec4(clamp(color.rgb, 0.0, 1.0), gl_FrontMaterial.diffuse.a);\n"
+    "    gl_Position = gl_ProjectionMatrix * eye_position;\n"
+    "}\n";
+
+const char* KEY_FRAGMENT_SHADER_SOURCE =
+    "#version 120\n"
+    "varying vec4 lit_color;\n"
+    "void main() {\n"
+    "    gl_FragColor = lit_color;\n"
+    "}\n";
+
 // --- 材質 (マテリアル) ---
 GLfloat MAT_BLACK_PLASTIC_AMBIENT[] = { 0.0f, 0.0f, 0.0f, 1.0f };
 GLfloat MAT_BLACK_PLASTIC_DIFFUSE[] = { 0.01f, 0.01f, 0.01f, 1.0f };
@@ -194,6 +737,9 @@ GLfloat MAT_GREY_PLASTIC_DIFFUSE[] = { 0.5f, 0.5f, 0.5f, 1.0f };
 GLfloat MAT_GREY_PLASTIC_SPECULAR[] = { 0.6f, 0.6f, 0.6f, 1.0f };
 GLfloat MAT_GREY_PLASTIC_SHININESS = 70.0f;
 
+GLfloat MAT_HOVER_EMISSION[] = { 0.25f, 0.25f, 0.15f, 1.0f };
+GLfloat MAT_NO_EMISSION[] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
 
 // ============================================================================
 // 関数プロトタイプ宣言
@@ -203,49 +749,208 @@ GLfloat MAT_GREY_PLASTIC_SHININESS = 70.0f;
 void initialize_application();
 void initialize_opengl();
 void initialize_piano_keys();
+void initialize_voice_pool();
 void initialize_camera();
+void initialize_key_instancing();
+void initialize_hud();
+void build_hud_font_atlas();
+void initialize_scene_objects();
+void add_scene_object(scene_object_type_e type, int index, bounding_box_t world_bbox);
+GLuint compile_shader_program(const char* vertex_source, const char* fragment_source);
+GLuint compile_shader(GLenum shader_type, const char* source);
 void cleanup_application();
+void free_audio_data();
+
+// --- 非同期アセット読み込み ---
+void start_asset_loading();
+void add_asset_job(asset_type_e type, const char* filename, int timbre_index, model_3d_t* model, GLuint* texture);
+ma_thread_result MA_THREADCALL asset_loader_thread(void* data);
+int run_next_asset_job();
+void upload_asset_job(asset_job_t* job);
+void on_loading_timer(int timer_value);
+void finish_asset_loading();
+int start_audio_device();
+void stop_audio_device();
+void report_audio_device();
+
+// --- ヘッドレス実行モード ---
+int parse_audio_options(int* argc, char** argv);
+int parse_audio_backend_name(const char* name, ma_backend* backend);
+int is_same_name_ignore_case(const char* a, const char* b);
+int run_command_line_mode(int argc, char** argv);
+int run_offline_render(const char* score_filename, const char* timbre_filename, float tempo, const char* output_filename);
+void discard_ui_events();
+int run_render_benchmark(const char* output_filename);
+int run_device_test(double duration_s);
+int run_render_thread_check(int thread_count);
+void render_thread_check_chord(float* output_buffer, int frame_count);
+void prepare_benchmark_timbre(timbre_t* timbre, int harmonic_count);
 
 // --- データ読み込み ---
-model_3d_t load_obj_model(const char* filename);
-GLuint load_ppm_texture(const char* filename);
+int load_obj_model(const char* filename, mesh_data_t* mesh);
+void upload_model_mesh(model_3d_t* model, mesh_data_t* mesh);
+void free_mesh_data(mesh_data_t* mesh);
+int parse_obj_buffer(const char* data, size_t size, const char* obj_filename, obj_parse_state_t* state);
+void parse_obj_face(obj_parse_state_t* state, const char* cursor, const char* line_end);
+void load_mtl_file(const char* filename, obj_parse_state_t* state);
+int find_obj_material(const obj_parse_state_t* state, const char* name, size_t name_length);
+void free_obj_parse_state(obj_parse_state_t* state);
+int find_or_add_mesh_vertex(int* hash_table, int hash_mask, int (*vertex_keys)[3], mesh_vertex_t* mesh_vertices, int* mesh_vertex_count,
+    const int key[3], float (*vertices)[3], float (*normals)[3], int normal_count, float (*tex_coords)[2], int tex_coord_count);
+void upload_model_buffers(model_3d_t* model, const mesh_vertex_t* vertices, int vertex_count, const GLuint* indices, int index_count);
+int load_mesh_cache(const char* cache_filename, const char* source_filename, mesh_data_t* mesh);
+int check_mesh_cache_source(const char* cache_filename, const char* source_filename, ma_uint64 source_size, ma_int64 source_mtime);
+void write_mesh_cache(const char* cache_filename, const char* source_filename, const mesh_data_t* mesh);
+void delete_model_buffers(model_3d_t* model);
+int load_ppm_texture(const char* filename, image_data_t* image);
+const unsigned char* scan_pnm_value(const unsigned char* cursor, const unsigned char* end, int* value);
+GLuint upload_texture_image(const image_data_t* image);
+void free_image_data(image_data_t* image);
 void load_timbre_file(const char* filename, int timbre_index);
+void build_timbre_wavetables(timbre_t* timbre);
 void load_sequence_file(const char* filename, float tempo);
 
 // --- 描画処理 ---
 void display();
 void draw_floor();
+void draw_model(const model_3d_t* model, int use_model_materials);
+void apply_model_material(const model_material_t* material);
+void set_model_vertex_arrays(int enable);
 void draw_piano_body();
 void draw_piano_keys();
+void draw_piano_keys_per_key();
+void draw_key_instances(const model_3d_t* model, int first_instance, int instance_count);
+void update_key_instance_buffer();
+void set_hover_emission(int scene_object_index);
 void draw_buttons();
 void draw_hud();
-void draw_reticle();
+void update_hud_vertex_buffer(const hud_state_t* state);
+int append_hud_status_lines(hud_vertex_t* vertices, const hud_state_t* state);
+void append_hud_text(hud_vertex_t* vertices, int* vertex_count, int line_index, const char* text, const GLubyte color[4]);
+void append_hud_quad(hud_vertex_t* vertices, int* vertex_count, float x0, float y0, float x1, float y1,
+    float u0, float v0, float u1, float v1, const GLubyte color[4]);
+void capture_hud_audio_stats();
+int has_hud_audio_alert_changed(const hud_audio_stats_t* previous, const hud_audio_stats_t* current);
+void on_hud_refresh_timer(int timer_value);
 
 // --- 入力・イベント処理 ---
 void on_mouse_button(int button, int state, int x, int y);
 void on_keyboard_press(unsigned char key, int x, int y);
 void on_mouse_move(int x, int y);
 void on_menu_select(int menu_id);
+void on_reshape(int width, int height);
+
+// --- 描画フレーム制御 ---
+void request_redisplay();
+void on_frame_timer(int timer_value);
+void enable_vsync();
 
 // --- アニメーション・シーケンサー ---
 void update_key_animation(int timer_value);
-void play_next_sequence_note(int previous_midi_note);
+void start_animation_timer();
+void set_key_target_y(int key_index, float target_y_pos);
+void advance_key_animation(double now_s);
+void step_key_animation();
+float get_key_render_y(const piano_key_t* key);
+void process_ui_events();
+void start_sequencer(ma_uint64 start_time);
+void stop_sequencer(int reached_end);
+void advance_sequencer(ma_uint64 now);
+ma_uint64 get_sequencer_next_frame();
 
 // --- オーディオ処理 ---
 void audio_callback(ma_device* p_device, void* p_output, const void* p_input, ma_uint32 frame_count);
+void synthesize_audio(float* output_buffer, ma_uint32 frame_count);
+void render_voice_block(voice_t* voice, const timbre_t* timbre, int octave_shift, float* mix_buffer, int block_frames);
 void trigger_note_on(int midi_note);
 void trigger_note_off(int midi_note);
+void trigger_all_notes_off();
+void post_audio_event(audio_event_type_e type, int value);
+int push_audio_event(audio_event_queue_t* queue, audio_event_type_e type, int value, ma_uint64 frame_time);
+audio_event_t* peek_audio_event(audio_event_queue_t* queue);
+void pop_audio_event(audio_event_queue_t* queue);
+void apply_audio_event(const audio_event_t* event);
+void start_note_voice(int midi_note);
+void release_note_voice(int midi_note);
+void release_all_voices();
+int allocate_voice();
+void steal_voice();
+void render_audio_frames(float* output_buffer, ma_uint32 frame_count);
+void remove_finished_voices();
+void record_audio_callback_timing(double start_s, ma_uint32 frame_count);
+void record_render_ahead_chunk_timing(double start_s, ma_uint32 frame_count);
+void record_input_latency(double post_time_s);
+void write_audio_timing_report();
+
+// --- 並列音声合成 ---
+void start_render_workers();
+void stop_render_workers();
+ma_thread_result MA_THREADCALL render_worker_thread(void* data);
+void pin_render_thread(int core_index);
+void dispatch_render_workers(const timbre_t* timbre, int octave_shift, int block_frames);
+void collect_render_workers(int block_frames);
+void park_render_workers();
+void wait_render_spin(int* spin_count);
+
+// --- 先行合成 ---
+int start_render_ahead(ma_uint32 device_period_frames, ma_uint32 device_period_count);
+void stop_render_ahead();
+ma_thread_result MA_THREADCALL render_ahead_thread(void* data);
+void read_render_ahead_frames(float* output_buffer, ma_uint32 frame_count);
+
+// --- 音声合成カーネル ---
+void select_voice_render_kernel();
+float measure_voice_render_kernel_error(voice_render_kernel_t kernel);
+void render_voice_scalar(float* mix_buffer, const float* table, double* phase, double phase_increment, float gain, float gain_step, int frame_count);
+#if defined(PIANO_SIMD_X86)
+void render_voice_sse2(float* mix_buffer, const float* table, double* phase, double phase_increment, float gain, float gain_step, int frame_count);
+void render_voice_avx2(float* mix_buffer, const float* table, double* phase, double phase_increment, float gain, float gain_step, int frame_count);
+int cpu_supports_avx2();
+#elif defined(PIANO_SIMD_NEON)
+void render_voice_neon(float* mix_buffer, const float* table, double* phase, double phase_increment, float gain, float gain_step, int frame_count);
+#endif
+
+// --- シーンオブジェクト・BVH ---
+int build_bvh_node(int first_object, int object_count);
+int compare_scene_objects_on_axis(const void* a, const void* b);
+pick_result_t pick_object_along_ray(vector_3d_t origin, vector_3d_t direction);
+void update_scene_visibility();
+void cull_bvh_node(int node_index, const float planes[6][4]);
+int classify_bbox_in_frustum(bounding_box_t box, const float planes[6][4]);
+void set_bvh_node_visible(int node_index);
+void update_hovered_object();
+int get_scene_object_index(scene_object_type_e type, int index);
 
 // --- ユーティリティ ---
 float midi_to_freq(int midi_note);
-vector_3d_t get_world_pos_from_screen_center();
-int is_point_in_box(vector_3d_t point, bounding_box_t box);
+double wrap_phase(double phase);
+const float* get_wavetable_for_note(const timbre_t* timbre, int midi_note);
+bounding_box_t transform_bbox(bounding_box_t local_bbox, float x, float y, float z, float yaw_degrees);
+int intersect_ray_bbox(vector_3d_t origin, vector_3d_t inverse_direction, bounding_box_t box, double* hit_distance);
+int map_file(const char* filename, mapped_file_t* mapped_file);
+void unmap_file(mapped_file_t* mapped_file);
+int get_cpu_core_count();
+int get_file_stamp(const char* filename, ma_uint64* size, ma_int64* mtime);
+ma_uint64 hash_bytes(const unsigned char* data, size_t size);
+int grow_array(void** array, int* capacity, int required_count, size_t element_size);
+const char* skip_spaces(const char* cursor, const char* end);
+const char* scan_float(const char* cursor, const char* end, float* value);
+const char* scan_int(const char* cursor, const char* end, int* value);
+size_t trim_line_length(const char* cursor, const char* line_end);
 
 
 // ============================================================================
 // main: プログラムのエントリーポイント
 // ============================================================================
 int main(int argc, char** argv) {
+    ma_timer_init(&g_monotonic_timer);
+
+    if (!parse_audio_options(&argc, argv)) return 1;
+
+    // ウィンドウやオーディオデバイスを使わないモードが指定されていればそれだけを実行する
+    int exit_code = run_command_line_mode(argc, argv);
+    if (exit_code >= 0) return exit_code;
+
     glutInit(&argc, argv);
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
 
@@ -258,17 +963,18 @@ int main(int argc, char** argv) {
     glutCreateMenu(on_menu_select);
     glutAddMenuEntry("Play Sequence", MENU_ID_SEQ_PLAY);
     glutAddMenuEntry("Stop Sequence", MENU_ID_SEQ_STOP);
+    glutAddMenuEntry("All Notes Off", MENU_ID_ALL_NOTES_OFF);
     glutAttachMenu(GLUT_RIGHT_BUTTON);
 
     initialize_application();
 
     glutDisplayFunc(display);
+    glutReshapeFunc(on_reshape);
     glutMouseFunc(on_mouse_button);
     glutKeyboardFunc(on_keyboard_press);
     glutPassiveMotionFunc(on_mouse_move);
 
     glutSetCursor(GLUT_CURSOR_NONE);
-    glutTimerFunc(ANIMATION_TIMER_MS, update_key_animation, 0);
 
     glutMainLoop();
     cleanup_application();
@@ -277,51 +983,493 @@ int main(int argc, char** argv) {
 
 
 // ============================================================================
-// 初期化・終了処理
+// ヘッドレス実行モード
 // ============================================================================
 
-void initialize_application() {
-    printf("アプリケーションを初期化しています...\n");
+// ASCII の英字だけ大文字小文字を区別せずに比べる
+int is_same_name_ignore_case(const char* a, const char* b) {
+    for (; *a != '\0' && *b != '\0'; ++a, ++b) {
+        char ca = (*a >= 'A' && *a <= 'Z') ? (char)(*a - 'A' + 'a') : *a;
+        char cb = (*b >= 'A' && *b <= 'Z') ? (char)(*b - 'A' + 'a') : *b;
+        if (ca != cb) return 0;
+    }
+    return *a == *b;
+}
 
-    initialize_opengl();
-    initialize_camera();
+// バックエンド名を大文字小文字を区別せずに解釈する。miniaudio の表示名 ("WASAPI", "Core Audio" など) と短い別名を受け付ける
+int parse_audio_backend_name(const char* name, ma_backend* backend) {
+    static const struct { const char* alias; ma_backend backend; } aliases[] = {
+        { "dsound", ma_backend_dsound },
+        { "coreaudio", ma_backend_coreaudio },
+        { "pulse", ma_backend_pulseaudio },
+        { "opensl", ma_backend_opensl },
+        { "webaudio", ma_backend_webaudio },
+    };
+    for (int i = 0; i < (int)(sizeof(aliases) / sizeof(aliases[0])); ++i) {
+        if (is_same_name_ignore_case(name, aliases[i].alias)) {
+            *backend = aliases[i].backend;
+            return 1;
+        }
+    }
+    for (int i = 0; i <= (int)ma_backend_null; ++i) {
+        if (is_same_name_ignore_case(name, ma_get_backend_name((ma_backend)i))) {
+            *backend = (ma_backend)i;
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    g_model_piano_body = load_obj_model("object/Body.obj");
-    g_model_white_key = load_obj_model("object/WhiteKey.obj");
-    g_model_black_key = load_obj_model("object/BlackKey.obj");
-    g_model_timbre_button = load_obj_model("object/Botton.obj");
-    g_model_octave_button = load_obj_model("object/Botton2.obj");
-    g_texture_wood = load_ppm_texture("textures/tile.ppm");
+// どのモードにも共通する音声設定を取り出し、argv から取り除く。値が不正なら 0 を返す
+int parse_audio_options(int* argc, char** argv) {
+    int remaining_count = 1;
+    for (int i = 1; i < *argc; ++i) {
+        if (strcmp(argv[i], "--polyphony") == 0 && i + 1 < *argc) {
+            int polyphony = atoi(argv[++i]);
+            if (polyphony < 1 || polyphony > VOICE_POOL_SIZE) {
+                fprintf(stderr, "エラー: 同時発音数 '%s' が不正です (1〜%d)。\n", argv[i], VOICE_POOL_SIZE);
+                return 0;
+            }
+            g_max_polyphony = polyphony;
+            continue;
+        }
+        if (strcmp(argv[i], "--render-threads") == 0 && i + 1 < *argc) {
+            int thread_count = atoi(argv[++i]);
+            if (thread_count < 1 || thread_count > RENDER_THREAD_MAX) {
+                fprintf(stderr, "エラー: 合成スレッド数 '%s' が不正です (1〜%d)。\n", argv[i], RENDER_THREAD_MAX);
+                return 0;
+            }
+            g_render_thread_count = thread_count;
+            continue;
+        }
+        if (strcmp(argv[i], "--render-ahead") == 0 && i + 1 < *argc) {
+            int ahead_ms = atoi(argv[++i]);
+            if (ahead_ms < 0 || ahead_ms > RENDER_AHEAD_MAX_MS) {
+                fprintf(stderr, "エラー: 先行合成量 '%s' が不正です (0〜%d ms)。\n", argv[i], RENDER_AHEAD_MAX_MS);
+                return 0;
+            }
+            g_render_ahead_ms = ahead_ms;
+            continue;
+        }
+        if (strcmp(argv[i], "--sample-rate") == 0 && i + 1 < *argc) {
+            int sample_rate = atoi(argv[++i]);
+            if (sample_rate < AUDIO_SAMPLE_RATE_MIN || sample_rate > AUDIO_SAMPLE_RATE_MAX) {
+                fprintf(stderr, "エラー: サンプルレート '%s' が不正です (%d〜%d Hz)。\n", argv[i], AUDIO_SAMPLE_RATE_MIN, AUDIO_SAMPLE_RATE_MAX);
+                return 0;
+            }
+            g_audio_config.sample_rate = (ma_uint32)sample_rate;
+            continue;
+        }
+        if (strcmp(argv[i], "--period-frames") == 0 && i + 1 < *argc) {
+            int period_frames = atoi(argv[++i]);
+            if (period_frames < 0 || period_frames > AUDIO_PERIOD_FRAMES_MAX) {
+                fprintf(stderr, "エラー: 周期のフレーム数 '%s' が不正です (0〜%d、0=既定値)。\n", argv[i], AUDIO_PERIOD_FRAMES_MAX);
+                return 0;
+            }
+            g_audio_config.period_frames = (ma_uint32)period_frames;
+            continue;
+        }
+        if (strcmp(argv[i], "--periods") == 0 && i + 1 < *argc) {
+            int period_count = atoi(argv[++i]);
+            if (period_count < 0 || period_count > AUDIO_PERIOD_COUNT_MAX) {
+                fprintf(stderr, "エラー: 周期数 '%s' が不正です (0〜%d、0=既定値)。\n", argv[i], AUDIO_PERIOD_COUNT_MAX);
+                return 0;
+            }
+            g_audio_config.period_count = (ma_uint32)period_count;
+            continue;
+        }
+        if (strcmp(argv[i], "--profile") == 0 && i + 1 < *argc) {
+            const char* profile = argv[++i];
+            if (strcmp(profile, "low-latency") == 0) {
+                g_audio_config.performance_profile = ma_performance_profile_low_latency;
+            }
+            else if (strcmp(profile, "conservative") == 0) {
+                g_audio_config.performance_profile = ma_performance_profile_conservative;
+            }
+            else {
+                fprintf(stderr, "エラー: 性能プロファイル '%s' が不正です (low-latency / conservative)。\n", profile);
+                return 0;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--backend") == 0 && i + 1 < *argc) {
+            if (!parse_audio_backend_name(argv[++i], &g_audio_config.backend)) {
+                fprintf(stderr, "エラー: オーディオバックエンド '%s' が不正です。\n", argv[i]);
+                return 0;
+            }
+            g_audio_config.has_backend = 1;
+            continue;
+        }
+        argv[remaining_count++] = argv[i];
+    }
+    *argc = remaining_count;
+    argv[remaining_count] = NULL;
+    return 1;
+}
 
-    load_timbre_file("timbres/neiro0.txt", 0);
-    load_timbre_file("timbres/neiro1.txt", 1);
-    load_timbre_file("timbres/neiro2.txt", 2);
-    load_timbre_file("timbres/neiro3.txt", 3);
+// 該当するモードが無ければ -1 を返し、通常のGUI起動に進む
+int run_command_line_mode(int argc, char** argv) {
+    if (argc < 2) return -1;
 
-    load_sequence_file("gakufu/kirakira.txt", 120.0f);
-    initialize_piano_keys();
+    if (strcmp(argv[1], "--render") == 0) {
+        if (argc != 6) {
+            fprintf(stderr, "使い方: %s --render <楽譜ファイル> <音色ファイル> <テンポ> <出力WAVファイル>\n", argv[0]);
+            return 1;
+        }
+        float tempo = (float)atof(argv[4]);
+        if (tempo <= 0.0f) {
+            fprintf(stderr, "エラー: テンポ '%s' が不正です。\n", argv[4]);
+            return 1;
+        }
+        return run_offline_render(argv[2], argv[3], tempo, argv[5]);
+    }
+    if (strcmp(argv[1], "--audio-stats") == 0) {
+        // GUIを通常どおり起動し、終了時にコールバック統計をCSVへ書き出す
+        g_audio_stats_filename = (argc >= 3) ? argv[2] : "audio_stats.csv";
+        atexit(write_audio_timing_report);
+        return -1;
+    }
+    if (strcmp(argv[1], "--bench") == 0) {
+        // 出力ファイルを省略した場合は標準出力へCSVを書き出す
+        return run_render_benchmark(argc >= 3 ? argv[2] : NULL);
+    }
+    if (strcmp(argv[1], "--device-test") == 0) {
+        // ウィンドウを開かずに再生デバイスだけを動かす (CIでは --backend null と組み合わせる)
+        double duration_s = (argc >= 3) ? atof(argv[2]) : DEVICE_TEST_DEFAULT_S;
+        if (duration_s <= 0.0) {
+            fprintf(stderr, "エラー: 再生時間 '%s' が不正です。\n", argv[2]);
+            return 1;
+        }
+        return run_device_test(duration_s);
+    }
+    if (strcmp(argv[1], "--thread-check") == 0) {
+        int thread_count = (argc >= 3) ? atoi(argv[2]) : 4;
+        if (thread_count < 2 || thread_count > RENDER_THREAD_MAX) {
+            fprintf(stderr, "エラー: スレッド数 '%s' が不正です (2〜%d)。\n", argv[2], RENDER_THREAD_MAX);
+            return 1;
+        }
+        return run_render_thread_check(thread_count);
+    }
 
-    ma_device_config device_config = ma_device_config_init(ma_device_type_playback);
-    device_config.playback.format = ma_format_f32;
-    device_config.playback.channels = 2;
-    device_config.sampleRate = AUDIO_SAMPLE_RATE;
-    device_config.dataCallback = audio_callback;
-    device_config.pUserData = g_piano_keys;
+    return -1;
+}
 
-    if (ma_device_init(NULL, &device_config, &g_audio_device) != MA_SUCCESS) {
-        fprintf(stderr, "エラー: 再生デバイスの初期化に失敗しました。\n");
-        return;
+// audio_callback と同じ合成処理で楽譜を最後まで描画し、実時間を待たずにWAVへ書き出す
+int run_offline_render(const char* score_filename, const char* timbre_filename, float tempo, const char* output_filename) {
+    static float output_buffer[OFFLINE_RENDER_CHUNK_FRAMES * 2];
+
+    load_timbre_file(timbre_filename, 0);
+    load_sequence_file(score_filename, tempo);
+    initialize_voice_pool();
+    select_voice_render_kernel();
+
+    if (g_sequence_length == 0 || g_timbres[0].wavetables == NULL) {
+        fprintf(stderr, "エラー: 楽譜または音色を読み込めなかったため描画を中止します。\n");
+        free_audio_data();
+        return 1;
     }
-    if (ma_device_start(&g_audio_device) != MA_SUCCESS) {
-        fprintf(stderr, "エラー: 再生デバイスの開始に失敗しました。\n");
-        ma_device_uninit(&g_audio_device);
+
+    ma_encoder_config encoder_config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32, 2, g_audio_config.sample_rate);
+    ma_encoder encoder;
+    if (ma_encoder_init_file(output_filename, &encoder_config, &encoder) != MA_SUCCESS) {
+        fprintf(stderr, "エラー: 出力ファイル '%s' を作成できません。\n", output_filename);
+        free_audio_data();
+        return 1;
+    }
+
+    g_audio_timbre_index = 0;
+    g_audio_octave_shift = 0;
+    start_render_workers();
+    start_sequencer(g_audio_frame_clock);
+
+    ma_timer timer;
+    ma_timer_init(&timer);
+    double start_time = ma_timer_get_time_in_seconds(&timer);
+
+    // シーケンス終了後もリリース中のボイスが鳴り終わるまで描画する
+    ma_uint64 total_frames = 0;
+    while (g_sequencer.is_playing || g_active_voice_count > 0) {
+        audio_callback(NULL, output_buffer, NULL, OFFLINE_RENDER_CHUNK_FRAMES);
+        discard_ui_events();
+        ma_encoder_write_pcm_frames(&encoder, output_buffer, OFFLINE_RENDER_CHUNK_FRAMES, NULL);
+        total_frames += OFFLINE_RENDER_CHUNK_FRAMES;
+    }
+
+    double elapsed_s = ma_timer_get_time_in_seconds(&timer) - start_time;
+    ma_encoder_uninit(&encoder);
+    stop_render_workers();
+
+    double audio_s = (double)total_frames / g_audio_config.sample_rate;
+    printf("情報: '%s' を書き出しました (%.2f 秒, %llu フレーム)。\n", output_filename, audio_s, (unsigned long long)total_frames);
+    printf("情報: 描画時間 %.3f 秒 (実時間比 %.1f 倍)\n", elapsed_s, elapsed_s > 0.0 ? audio_s / elapsed_s : 0.0);
+
+    free_audio_data();
+    return 0;
+}
+
+// 同時発音数 × 倍音数 × バッファサイズの組み合わせごとに audio_callback の処理時間を測定する
+int run_render_benchmark(const char* output_filename) {
+    static const int voice_counts[] = { 1, 2, 4, 8, 16, 24, 32, 48, VOICE_POOL_SIZE };
+    static const int harmonic_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    static const int buffer_sizes[] = { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    static float output_buffer[BENCHMARK_MAX_BUFFER_FRAMES * 2];
+
+    FILE* file = stdout;
+    if (output_filename != NULL && (fopen_s(&file, output_filename, "w") != 0 || file == NULL)) {
+        fprintf(stderr, "エラー: ベンチマーク結果ファイル '%s' を作成できません。\n", output_filename);
+        return 1;
+    }
+
+    // 測定する同時発音数がボイスの奪い合いで減らないよう、上限をプール全体に広げる
+    int max_polyphony = g_max_polyphony;
+    g_max_polyphony = VOICE_POOL_SIZE;
+    start_render_workers();
+    fprintf(file, "kernel,voices,harmonics,buffer_frames,ns_per_frame,ns_per_voice_frame,realtime_factor,mean_callback_us,worst_callback_us,budget_us,render_threads\n");
+
+    ma_timer timer;
+    ma_timer_init(&timer);
+    int result_count = 0;
+
+    for (int h = 0; h < (int)(sizeof(harmonic_counts) / sizeof(harmonic_counts[0])); ++h) {
+        prepare_benchmark_timbre(&g_timbres[0], harmonic_counts[h]);
+        if (g_timbres[0].wavetables == NULL) break;
+        // SIMDカーネルをスカラー版と比べるにはウェーブテーブルが必要なため、最初の音色を作ってから選ぶ
+        if (h == 0) select_voice_render_kernel();
+        g_audio_timbre_index = 0;
+        g_audio_octave_shift = 0;
+
+        for (int v = 0; v < (int)(sizeof(voice_counts) / sizeof(voice_counts[0])); ++v) {
+            for (int b = 0; b < (int)(sizeof(buffer_sizes) / sizeof(buffer_sizes[0])); ++b) {
+                ma_uint32 buffer_frames = (ma_uint32)buffer_sizes[b];
+
+                initialize_voice_pool();
+                for (int i = 0; i < voice_counts[v]; ++i) {
+                    start_note_voice(MIDI_NOTE_START + i);
+                }
+
+                // アタックを抜けてキャッシュが温まるまで測定対象外で描画する
+                for (ma_uint32 frames = 0; frames < g_audio_config.sample_rate / 10; frames += buffer_frames) {
+                    audio_callback(NULL, output_buffer, NULL, buffer_frames);
+                }
+
+                int callback_count = (int)(BENCHMARK_DURATION_S * g_audio_config.sample_rate / buffer_frames);
+                double total_s = 0.0;
+                double worst_s = 0.0;
+                for (int c = 0; c < callback_count; ++c) {
+                    double start_s = ma_timer_get_time_in_seconds(&timer);
+                    audio_callback(NULL, output_buffer, NULL, buffer_frames);
+                    double duration_s = ma_timer_get_time_in_seconds(&timer) - start_s;
+                    total_s += duration_s;
+                    if (duration_s > worst_s) worst_s = duration_s;
+                }
+
+                double total_frames = (double)callback_count * buffer_frames;
+                double ns_per_frame = total_s * 1.0e9 / total_frames;
+                fprintf(file, "%s,%d,%d,%u,%.3f,%.3f,%.1f,%.3f,%.3f,%.3f,%d\n",
+                    g_render_voice_kernel_name, voice_counts[v], harmonic_counts[h], buffer_frames,
+                    ns_per_frame,
+                    ns_per_frame / voice_counts[v],
+                    total_s > 0.0 ? total_frames / g_audio_config.sample_rate / total_s : 0.0,
+                    total_s * 1.0e6 / callback_count,
+                    worst_s * 1.0e6,
+                    buffer_frames * 1.0e6 / g_audio_config.sample_rate,
+                    g_render_worker_count + 1);
+                result_count++;
+            }
+        }
+    }
+
+    if (file != stdout) {
+        fclose(file);
+        printf("情報: ベンチマーク結果 (%d 条件) を '%s' に書き出しました。\n", result_count, output_filename);
+    }
+    stop_render_workers();
+    initialize_voice_pool();
+    g_max_polyphony = max_polyphony;
+    free_audio_data();
+    return 0;
+}
+
+// 倍音の振幅が 1/n で減衰する測定用の音色を作る
+void prepare_benchmark_timbre(timbre_t* timbre, int harmonic_count) {
+    free(timbre->harmonics);
+    timbre->harmonics = (harmonic_t*)malloc(sizeof(harmonic_t) * harmonic_count);
+    if (timbre->harmonics == NULL) {
+        fprintf(stderr, "エラー: 倍音データのメモリ確保に失敗しました。\n");
+        timbre->harmonic_count = 0;
+        free(timbre->wavetables);
+        timbre->wavetables = NULL;
         return;
     }
 
-    printf("初期化が完了しました。\n");
+    timbre->harmonic_count = harmonic_count;
+    for (int i = 0; i < harmonic_count; ++i) {
+        timbre->harmonics[i] = (harmonic_t){ 1.0f / (i + 1), 0.0f };
+    }
+    sprintf_s(timbre->name, sizeof(timbre->name), "Benchmark %d", harmonic_count);
+    build_timbre_wavetables(timbre);
+}
+
+// 測定用の音色で打鍵・離鍵を繰り返し、コールバックが動くことと入力から合成までの遅延を確かめる
+int run_device_test(double duration_s) {
+    prepare_benchmark_timbre(&g_timbres[0], 8);
+    initialize_voice_pool();
+    select_voice_render_kernel();
+    g_audio_timbre_index = 0;
+    g_audio_octave_shift = 0;
+    if (g_timbres[0].wavetables == NULL || !start_audio_device()) {
+        free_audio_data();
+        return 1;
+    }
+
+    double start_s = ma_timer_get_time_in_seconds(&g_monotonic_timer);
+    double next_note_s = start_s;
+    int is_note_on = 0;
+    while (ma_timer_get_time_in_seconds(&g_monotonic_timer) - start_s < duration_s) {
+        if (ma_timer_get_time_in_seconds(&g_monotonic_timer) >= next_note_s) {
+            is_note_on = !is_note_on;
+            post_audio_event(is_note_on ? AUDIO_EVENT_NOTE_ON : AUDIO_EVENT_NOTE_OFF, MIDI_NOTE_A4);
+            next_note_s += DEVICE_TEST_NOTE_MS / 1000.0;
+        }
+        discard_ui_events();
+        ma_sleep(DEVICE_TEST_POLL_MS);
+    }
+    stop_audio_device();
+
+    audio_timing_stats_t* stats = &g_audio_timing_stats;
+    ma_uint64 callback_count = ma_atomic_load_explicit_64(&stats->callback_count, ma_atomic_memory_order_relaxed);
+    ma_uint64 latency_count = ma_atomic_load_explicit_64(&stats->input_latency_count, ma_atomic_memory_order_relaxed);
+    double mean_input_ms = latency_count > 0 ? ma_atomic_load_explicit_64(&stats->total_input_latency_ns, ma_atomic_memory_order_relaxed) / 1.0e6 / latency_count : 0.0;
+    double max_input_ms = ma_atomic_load_explicit_32(&stats->max_input_latency_ns, ma_atomic_memory_order_relaxed) / 1.0e6;
+    printf("情報: コールバック %llu 回、Xrun %llu 回、アンダーラン %llu 回\n",
+        (unsigned long long)callback_count,
+        (unsigned long long)ma_atomic_load_explicit_64(&stats->xrun_count, ma_atomic_memory_order_relaxed),
+        (unsigned long long)ma_atomic_load_explicit_64(&stats->underrun_count, ma_atomic_memory_order_relaxed));
+    printf("情報: 測定した入力→合成の遅延: 平均 %.3f ms / 最大 %.3f ms (打鍵 %llu 回)\n", mean_input_ms, max_input_ms, (unsigned long long)latency_count);
+    printf("情報: 入力→発音の遅延: 平均 %.3f ms / 最大 %.3f ms (バッファサイズから推定した出力側 %.3f ms を含む)\n",
+        mean_input_ms + g_output_latency_ms, max_input_ms + g_output_latency_ms, g_output_latency_ms);
+
+    free_audio_data();
+    if (callback_count == 0) {
+        fprintf(stderr, "エラー: オーディオコールバックが一度も呼ばれませんでした。\n");
+        return 1;
+    }
+    return 0;
+}
+
+// 同じ和音を1スレッドと指定スレッド数で描画して比べる。コア数による制限を外すので、1コアの環境でも並列経路を通る。
+// 部分和を足す順序が変わるため完全一致はせず、許容誤差は SIMD カーネルの検証と同じ AUDIO_KERNEL_TOLERANCE とする
+int run_render_thread_check(int thread_count) {
+    int frame_count = (int)(RENDER_CHECK_DURATION_S * g_audio_config.sample_rate);
+    float* expected = (float*)malloc(sizeof(float) * 2 * frame_count);
+    float* actual = (float*)malloc(sizeof(float) * 2 * frame_count);
+    prepare_benchmark_timbre(&g_timbres[0], 8);
+    if (expected == NULL || actual == NULL || g_timbres[0].wavetables == NULL) {
+        fprintf(stderr, "エラー: 検証用のメモリ確保に失敗しました。\n");
+        free(expected);
+        free(actual);
+        free_audio_data();
+        return 1;
+    }
+    select_voice_render_kernel();
+    g_audio_timbre_index = 0;
+    g_audio_octave_shift = 0;
+    int max_polyphony = g_max_polyphony;
+    g_max_polyphony = VOICE_POOL_SIZE;
+
+    g_render_thread_count = 1;
+    render_thread_check_chord(expected, frame_count);
+
+    g_render_thread_count = thread_count;
+    g_is_render_thread_count_forced = 1;
+    start_render_workers();
+    int worker_count = g_render_worker_count;
+    render_thread_check_chord(actual, frame_count);
+    stop_render_workers();
+    g_is_render_thread_count_forced = 0;
+    g_max_polyphony = max_polyphony;
+
+    float max_error = 0.0f;
+    int identical_count = 0;
+    for (int i = 0; i < frame_count * 2; ++i) {
+        float error = fabsf(expected[i] - actual[i]);
+        if (error > max_error) max_error = error;
+        if (memcmp(&expected[i], &actual[i], sizeof(float)) == 0) identical_count++;
+    }
+    free(expected);
+    free(actual);
+    free_audio_data();
+
+    printf("情報: %d スレッドと1スレッドの比較: 最大誤差 %g、ビット単位で一致したサンプル %.1f%%\n",
+        worker_count + 1, max_error, 100.0 * identical_count / (frame_count * 2));
+    if (worker_count == 0) {
+        fprintf(stderr, "エラー: 合成スレッドを起動できなかったため並列経路を検証できません。\n");
+        return 1;
+    }
+    if (max_error > AUDIO_KERNEL_TOLERANCE) {
+        fprintf(stderr, "エラー: 並列合成の結果が1スレッドの結果と一致しません。\n");
+        return 1;
+    }
+    return 0;
+}
+
+// 和音を鳴らし、半分の時点で RENDER_CHECK_HELD_VOICES 音を残して離鍵する (分割の閾値をまたぐ)
+void render_thread_check_chord(float* output_buffer, int frame_count) {
+    initialize_voice_pool();
+    for (int i = 0; i < RENDER_CHECK_VOICES; ++i) {
+        start_note_voice(MIDI_NOTE_START + i);
+    }
+    int is_released = 0;
+    for (int frame = 0; frame < frame_count; frame += OFFLINE_RENDER_CHUNK_FRAMES) {
+        if (!is_released && frame >= frame_count / 2) {
+            for (int i = RENDER_CHECK_HELD_VOICES; i < RENDER_CHECK_VOICES; ++i) {
+                release_note_voice(MIDI_NOTE_START + i);
+            }
+            is_released = 1;
+        }
+        int chunk_frames = frame_count - frame;
+        if (chunk_frames > OFFLINE_RENDER_CHUNK_FRAMES) chunk_frames = OFFLINE_RENDER_CHUNK_FRAMES;
+        audio_callback(NULL, output_buffer + frame * 2, NULL, (ma_uint32)chunk_frames);
+    }
+}
+
+// UIスレッドが存在しないモードでは鍵盤表示用の通知を読み捨てる
+void discard_ui_events() {
+    while (peek_audio_event(&g_ui_event_queue) != NULL) {
+        pop_audio_event(&g_ui_event_queue);
+    }
+}
+
+
+// ============================================================================
+// 初期化・終了処理
+// ============================================================================
+
+void initialize_application() {
+    printf("アプリケーションを初期化しています...\n");
+
+    initialize_opengl();
+    initialize_camera();
+    initialize_piano_keys();
+    initialize_voice_pool();
+    initialize_key_instancing();
+    initialize_hud();
+
+    // ファイルの読み込みはワーカースレッドで行い、完了したものから on_loading_timer で転送する
+    start_asset_loading();
 }
 
 void initialize_opengl() {
+    glewExperimental = GL_TRUE;
+    GLenum glew_result = glewInit();
+    if (glew_result != GLEW_OK) {
+        fprintf(stderr, "エラー: GLEWの初期化に失敗しました (%s)。\n", (const char*)glewGetErrorString(glew_result));
+    }
+    else if (!GLEW_VERSION_1_5) {
+        fprintf(stderr, "エラー: 頂点バッファオブジェクト (OpenGL 1.5) に対応していません。\n");
+    }
+    enable_vsync();
+
     glClearColor(0.6f, 0.8f, 1.0f, 1.0f);
     glEnable(GL_DEPTH_TEST);
     glShadeModel(GL_SMOOTH);
@@ -341,9 +1489,14 @@ void initialize_piano_keys() {
     int white_key_index = 0;
     int black_key_index = 0;
 
+    for (int note = 0; note < MIDI_NOTE_COUNT; ++note) {
+        g_note_keys[note] = -1;
+    }
+
     for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
         piano_key_t* key = &g_piano_keys[i];
         key->midi_note = i + MIDI_NOTE_START;
+        g_note_keys[key->midi_note] = i;
 
         int note_in_octave = (key->midi_note - 12) % 12;
         int is_black_key = (note_in_octave == 1 || note_in_octave == 3 || note_in_octave == 6 || note_in_octave == 8 || note_in_octave == 10);
@@ -363,864 +1516,3781 @@ void initialize_piano_keys() {
             white_key_index++;
         }
 
-        key->envelope_state = ENV_STATE_OFF;
-        key->wave_phase = 0.0;
-        key->current_amplitude = 0.0;
         key->current_y_pos = 0.0f;
+        key->previous_y_pos = 0.0f;
         key->target_y_pos = 0.0f;
+        key->is_animating = 0;
     }
+    g_animating_key_count = 0;
 }
 
-void initialize_camera() {
-    float rad_yaw = g_camera_yaw * M_PI / 180.0f;
-    float rad_pitch = g_camera_pitch * M_PI / 180.0f;
-
-    g_camera_front[0] = cos(rad_yaw) * cos(rad_pitch);
-    g_camera_front[1] = sin(rad_pitch);
-    g_camera_front[2] = sin(rad_yaw) * cos(rad_pitch);
-
-    float len = sqrt(pow(g_camera_front[0], 2) + pow(g_camera_front[1], 2) + pow(g_camera_front[2], 2));
-    g_camera_front[0] /= len;
-    g_camera_front[1] /= len;
-    g_camera_front[2] /= len;
+void initialize_voice_pool() {
+    for (int i = 0; i < VOICE_POOL_SIZE; ++i) {
+        g_voices[i].envelope_state = ENV_STATE_OFF;
+        g_voices[i].current_amplitude = 0.0;
+        // 番号の小さいボイスから使われるよう逆順に積む
+        g_free_voices[i] = VOICE_POOL_SIZE - 1 - i;
+    }
+    for (int note = 0; note < MIDI_NOTE_COUNT; ++note) {
+        g_note_voices[note] = -1;
+    }
+    g_free_voice_count = VOICE_POOL_SIZE;
+    g_active_voice_count = 0;
+    g_voice_start_counter = 0;
 }
 
-void cleanup_application() {
-    ma_device_uninit(&g_audio_device);
-
-    glDeleteLists(g_model_piano_body.display_list_id, 1);
-    glDeleteLists(g_model_white_key.display_list_id, 1);
-    glDeleteLists(g_model_black_key.display_list_id, 1);
-    glDeleteLists(g_model_timbre_button.display_list_id, 1);
-    glDeleteLists(g_model_octave_button.display_list_id, 1);
-    glDeleteTextures(1, &g_texture_wood);
-
-    for (int i = 0; i < TIMBRE_BUTTON_COUNT; ++i) {
-        free(g_timbres[i].harmonics);
-        g_timbres[i].harmonics = NULL;
+// 白鍵と黒鍵をそれぞれ1回のインスタンス描画で描くためのシェーダーとインスタンスバッファを用意する
+void initialize_key_instancing() {
+    g_white_key_count = 0;
+    for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
+        if (g_piano_keys[i].type == KEY_TYPE_WHITE) g_key_instance_order[g_white_key_count++] = i;
+    }
+    int instance_index = g_white_key_count;
+    for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
+        if (g_piano_keys[i].type == KEY_TYPE_BLACK) g_key_instance_order[instance_index++] = i;
     }
-    free(g_sequence);
-    g_sequence = NULL;
-
-    printf("リソースを解放しました。\n");
-}
 
+    if (!GLEW_VERSION_3_3) {
+        printf("情報: インスタンス描画 (OpenGL 3.3) に対応していないため、鍵盤を1つずつ描画します。\n");
+        return;
+    }
 
-// ============================================================================
-// データ読み込み
-// ============================================================================
+    g_key_shader_program = compile_shader_program(KEY_VERTEX_SHADER_SOURCE, KEY_FRAGMENT_SHADER_SOURCE);
+    if (g_key_shader_program == 0) return;
+    g_key_hover_emission_location = glGetUniformLocation(g_key_shader_program, "hover_emission");
 
-model_3d_t load_obj_model(const char* filename) {
-    model_3d_t model = { 0 };
-    FILE* file;
-    if (fopen_s(&file, filename, "r") != 0 || file == NULL) {
-        fprintf(stderr, "エラー: モデルファイル '%s' を開けません。\n", filename);
-        return model;
-    }
+    glGenBuffers(1, &g_key_instance_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, g_key_instance_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(float[4]) * PIANO_KEY_COUNT, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    g_are_key_instances_dirty = 1;
+}
 
-    int vertex_count = 0, normal_count = 0, tex_coord_count = 0;
-    char line_buffer[256];
-    while (fgets(line_buffer, sizeof(line_buffer), file)) {
-        if (strncmp(line_buffer, "v ", 2) == 0) vertex_count++;
-        else if (strncmp(line_buffer, "vn ", 3) == 0) normal_count++;
-        else if (strncmp(line_buffer, "vt ", 3) == 0) tex_coord_count++;
+GLuint compile_shader_program(const char* vertex_source, const char* fragment_source) {
+    GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, vertex_source);
+    GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, fragment_source);
+    if (vertex_shader == 0 || fragment_shader == 0) {
+        if (vertex_shader != 0) glDeleteShader(vertex_shader);
+        if (fragment_shader != 0) glDeleteShader(fragment_shader);
+        return 0;
     }
 
-    if (vertex_count == 0) {
-        fclose(file);
-        fprintf(stderr, "エラー: '%s' に頂点データがありません。\n", filename);
-        return model;
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, fragment_shader);
+    glBindAttribLocation(program, KEY_INSTANCE_ATTRIB_LOCATION, "instance_offset");
+    glLinkProgram(program);
+    glDeleteShader(vertex_shader);
+    glDeleteShader(fragment_shader);
+
+    GLint is_linked = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &is_linked);
+    if (!is_linked) {
+        char log_buffer[1024];
+        glGetProgramInfoLog(program, sizeof(log_buffer), NULL, log_buffer);
+        fprintf(stderr, "エラー: シェーダーのリンクに失敗しました。\n%s\n", log_buffer);
+        glDeleteProgram(program);
+        return 0;
     }
+    return program;
+}
 
-    float(*vertices)[3] = malloc(sizeof(float[3]) * vertex_count);
-    float(*normals)[3] = malloc(sizeof(float[3]) * normal_count);
-    float(*tex_coords)[2] = malloc(sizeof(float[2]) * tex_coord_count);
-
-    if (!vertices || (normal_count > 0 && !normals) || (tex_coord_count > 0 && !tex_coords)) {
-        fprintf(stderr, "エラー: モデルデータのメモリ確保に失敗しました。\n");
-        free(vertices); free(normals); free(tex_coords);
-        fclose(file);
-        return model;
+GLuint compile_shader(GLenum shader_type, const char* source) {
+    GLuint shader = glCreateShader(shader_type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    GLint is_compiled = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &is_compiled);
+    if (!is_compiled) {
+        char log_buffer[1024];
+        glGetShaderInfoLog(shader, sizeof(log_buffer), NULL, log_buffer);
+        fprintf(stderr, "エラー: シェーダーのコンパイルに失敗しました。\n%s\n", log_buffer);
+        glDeleteShader(shader);
+        return 0;
     }
+    return shader;
+}
 
-    rewind(file);
-    int v_idx = 0, vn_idx = 0, vt_idx = 0;
-    model.local_bbox.min = (vector_3d_t){ 1e9, 1e9, 1e9 };
-    model.local_bbox.max = (vector_3d_t){ -1e9, -1e9, -1e9 };
+void initialize_hud() {
+    glGenBuffers(1, &g_hud_vertex_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, g_hud_vertex_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(hud_vertex_t) * HUD_MAX_VERTICES, NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    capture_hud_audio_stats();
+    g_is_hud_state_valid = 0;
+    glutTimerFunc(HUD_REFRESH_MS, on_hud_refresh_timer, 0);
+}
 
-    while (fgets(line_buffer, sizeof(line_buffer), file)) {
-        if (strncmp(line_buffer, "v ", 2) == 0) {
-            float x, y, z;
-            sscanf_s(line_buffer, "v %f %f %f", &x, &y, &z);
-            vertices[v_idx][0] = x; vertices[v_idx][1] = y; vertices[v_idx][2] = z;
-            if (x < model.local_bbox.min.x) model.local_bbox.min.x = x;
-            if (x > model.local_bbox.max.x) model.local_bbox.max.x = x;
-            if (y < model.local_bbox.min.y) model.local_bbox.min.y = y;
-            if (y > model.local_bbox.max.y) model.local_bbox.max.y = y;
-            if (z < model.local_bbox.min.z) model.local_bbox.min.z = z;
-            if (z > model.local_bbox.max.z) model.local_bbox.max.z = z;
-            v_idx++;
-        }
-        else if (strncmp(line_buffer, "vn ", 3) == 0) {
-            sscanf_s(line_buffer, "vn %f %f %f", &normals[vn_idx][0], &normals[vn_idx][1], &normals[vn_idx][2]);
-            vn_idx++;
+// GLUTのビットマップフォントを1度だけ描き、読み戻してアルファテクスチャにする。
+// フレームバッファオブジェクトがあればそこへ描き、無ければバックバッファへ描く。バックバッファの場合はウィンドウが
+// アトラスより小さいと欠けるため、十分な大きさになるまで作成を見送る (その間HUDは表示しない)。
+// ウィンドウが表示されてから呼ぶ必要があるため、最初のフレームの glClear の前に実行する
+void build_hud_font_atlas() {
+    const int atlas_width = HUD_ATLAS_COLUMNS * HUD_GLYPH_CELL_SIZE;
+    const int atlas_height = HUD_ATLAS_ROWS * HUD_GLYPH_CELL_SIZE;
+    GLuint framebuffer_id = 0;
+    GLuint color_texture_id = 0;
+    if (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) {
+        glGenTextures(1, &color_texture_id);
+        glBindTexture(GL_TEXTURE_2D, color_texture_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlas_width, atlas_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &framebuffer_id);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_id);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color_texture_id, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glDeleteFramebuffers(1, &framebuffer_id);
+            glDeleteTextures(1, &color_texture_id);
+            framebuffer_id = 0;
+            color_texture_id = 0;
         }
-        else if (strncmp(line_buffer, "vt ", 3) == 0) {
-            sscanf_s(line_buffer, "vt %f %f", &tex_coords[vt_idx][0], &tex_coords[vt_idx][1]);
-            vt_idx++;
+    }
+    if (framebuffer_id == 0 && (g_window_width < atlas_width || g_window_height < atlas_height)) return;
+
+    GLubyte* pixels = (GLubyte*)malloc((size_t)atlas_width * atlas_height);
+    if (!pixels) {
+        fprintf(stderr, "エラー: フォントアトラス用のメモリ確保に失敗しました。\n");
+        if (framebuffer_id != 0) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glDeleteFramebuffers(1, &framebuffer_id);
+            glDeleteTextures(1, &color_texture_id);
         }
+        return;
     }
 
-    model.display_list_id = glGenLists(1);
-    if (model.display_list_id == 0) {
-        fprintf(stderr, "エラー: glGenListsに失敗しました。\n");
+    glPushAttrib(GL_ALL_ATTRIB_BITS);
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glViewport(0, 0, atlas_width, atlas_height);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0, atlas_width, 0, atlas_height);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_TEXTURE_2D);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glColor3f(1.0f, 1.0f, 1.0f);
+
+    for (int c = HUD_GLYPH_FIRST; c <= HUD_GLYPH_LAST; ++c) {
+        int cell = c - HUD_GLYPH_FIRST;
+        int cell_x = (cell % HUD_ATLAS_COLUMNS) * HUD_GLYPH_CELL_SIZE;
+        int cell_y = (cell / HUD_ATLAS_COLUMNS) * HUD_GLYPH_CELL_SIZE;
+        glRasterPos2i(cell_x + 1, cell_y + HUD_GLYPH_BASELINE);
+        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, c);
+        g_hud_glyph_advances[cell] = glutBitmapWidth(GLUT_BITMAP_HELVETICA_18, c);
     }
-    else {
-        glNewList(model.display_list_id, GL_COMPILE);
-        glBegin(GL_TRIANGLES);
-        rewind(file);
-        while (fgets(line_buffer, sizeof(line_buffer), file)) {
-            if (strncmp(line_buffer, "f ", 2) == 0) {
-                int v[3], vt[3], vn[3];
-                if (sscanf_s(line_buffer, "f %d/%d/%d %d/%d/%d %d/%d/%d",
-                    &v[0], &vt[0], &vn[0], &v[1], &vt[1], &vn[1], &v[2], &vt[2], &vn[2]) == 9) {
-                    for (int i = 0; i < 3; ++i) {
-                        if (vn[i] <= normal_count)   glNormal3fv(normals[vn[i] - 1]);
-                        if (vt[i] <= tex_coord_count) glTexCoord2fv(tex_coords[vt[i] - 1]);
-                        if (v[i] <= vertex_count)    glVertex3fv(vertices[v[i] - 1]);
-                    }
-                }
-            }
-        }
-        glEnd();
-        glEndList();
+    // 最後のセルは塗りつぶし、レティクルなどの単色の四角形に使う
+    glRecti(atlas_width - HUD_GLYPH_CELL_SIZE, atlas_height - HUD_GLYPH_CELL_SIZE, atlas_width, atlas_height);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, atlas_width, atlas_height, GL_RED, GL_UNSIGNED_BYTE, pixels);
+    if (framebuffer_id != 0) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer_id);
+        glDeleteTextures(1, &color_texture_id);
     }
 
-    fclose(file);
-    free(vertices);
-    free(normals);
-    free(tex_coords);
-
-    printf("情報: モデル '%s' を読み込みました (頂点: %d, 法線: %d, UV: %d)。\n", filename, vertex_count, normal_count, tex_coord_count);
-    return model;
-}
+    glGenTextures(1, &g_hud_font_texture);
+    glBindTexture(GL_TEXTURE_2D, g_hud_font_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, atlas_width, atlas_height, 0, GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glPopClientAttrib();
+    glPopAttrib();
+    free(pixels);
+    g_is_hud_state_valid = 0;
+}
+
+// 配置は固定なので、ワールド座標のバウンディングボックスとBVHは起動時に一度だけ構築する
+void initialize_scene_objects() {
+    g_scene_object_count = 0;
+
+    g_scene_object_first[SCENE_OBJECT_KEY] = g_scene_object_count;
+    for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
+        piano_key_t* key = &g_piano_keys[i];
+        model_3d_t* model = (key->type == KEY_TYPE_WHITE) ? &g_model_white_key : &g_model_black_key;
+        bounding_box_t world_bbox = transform_bbox(model->local_bbox, key->center_pos[0], key->center_pos[1], key->center_pos[2], 0.0f);
+        world_bbox.min.y += KEY_PRESSED_Y_OFFSET;   // 押下アニメーションで沈む範囲も含める
+        add_scene_object(SCENE_OBJECT_KEY, i, world_bbox);
+    }
+    g_scene_object_first[SCENE_OBJECT_TIMBRE_BUTTON] = g_scene_object_count;
+    for (int i = 0; i < TIMBRE_BUTTON_COUNT; ++i) {
+        add_scene_object(SCENE_OBJECT_TIMBRE_BUTTON, i,
+            transform_bbox(g_model_timbre_button.local_bbox, TIMBRE_BUTTON_X_POSITIONS[i], BUTTON_Y, BUTTON_Z, 0.0f));
+    }
+    g_scene_object_first[SCENE_OBJECT_OCTAVE_BUTTON] = g_scene_object_count;
+    for (int i = 0; i < OCTAVE_BUTTON_COUNT; ++i) {
+        add_scene_object(SCENE_OBJECT_OCTAVE_BUTTON, i, transform_bbox(g_model_octave_button.local_bbox,
+            OCTAVE_BUTTON_POSITIONS[i][0], OCTAVE_BUTTON_POSITIONS[i][1], OCTAVE_BUTTON_POSITIONS[i][2], OCTAVE_BUTTON_POSITIONS[i][3]));
+    }
+
+    for (int i = 0; i < g_scene_object_count; ++i) {
+        g_bvh_object_order[i] = i;
+        g_is_scene_object_visible[i] = 1;
+    }
+    g_bvh_node_count = 0;
+    build_bvh_node(0, g_scene_object_count);
+    printf("情報: シーンオブジェクト %d 個からBVHを構築しました (ノード数: %d)。\n", g_scene_object_count, g_bvh_node_count);
+}
+
+void add_scene_object(scene_object_type_e type, int index, bounding_box_t world_bbox) {
+    if (g_scene_object_count >= SCENE_OBJECT_MAX) {
+        fprintf(stderr, "警告: シーンオブジェクト数が上限 (%d) に達しました。\n", SCENE_OBJECT_MAX);
+        return;
+    }
+    g_scene_objects[g_scene_object_count++] = (scene_object_t){ type, index, world_bbox };
+}
+
+void initialize_camera() {
+    float rad_yaw = g_camera_yaw * M_PI / 180.0f;
+    float rad_pitch = g_camera_pitch * M_PI / 180.0f;
+
+    g_camera_front[0] = cos(rad_yaw) * cos(rad_pitch);
+    g_camera_front[1] = sin(rad_pitch);
+    g_camera_front[2] = sin(rad_yaw) * cos(rad_pitch);
+
+    float len = sqrt(pow(g_camera_front[0], 2) + pow(g_camera_front[1], 2) + pow(g_camera_front[2], 2));
+    g_camera_front[0] /= len;
+    g_camera_front[1] /= len;
+    g_camera_front[2] /= len;
+}
+
+void cleanup_application() {
+    if (g_is_audio_started) stop_audio_device();
+
+    delete_model_buffers(&g_model_piano_body);
+    delete_model_buffers(&g_model_white_key);
+    delete_model_buffers(&g_model_black_key);
+    delete_model_buffers(&g_model_timbre_button);
+    delete_model_buffers(&g_model_octave_button);
+    if (g_key_shader_program != 0) glDeleteProgram(g_key_shader_program);
+    if (g_key_instance_buffer_id != 0) glDeleteBuffers(1, &g_key_instance_buffer_id);
+    if (g_hud_vertex_buffer_id != 0) glDeleteBuffers(1, &g_hud_vertex_buffer_id);
+    if (g_hud_font_texture != 0) glDeleteTextures(1, &g_hud_font_texture);
+    glDeleteTextures(1, &g_texture_wood);
+
+    free_audio_data();
+
+    printf("リソースを解放しました。\n");
+}
+
+void free_audio_data() {
+    for (int i = 0; i < TIMBRE_BUTTON_COUNT; ++i) {
+        free(g_timbres[i].harmonics);
+        g_timbres[i].harmonics = NULL;
+        free(g_timbres[i].wavetables);
+        g_timbres[i].wavetables = NULL;
+    }
+    free(g_sequence);
+    g_sequence = NULL;
+    g_sequence_length = 0;
+}
+
+
+// ============================================================================
+// 非同期アセット読み込み
+// ============================================================================
+
+// 音色を先頭に並べ、最初に取り出されるようにする (音色がそろえば音を出せる)
+void start_asset_loading() {
+    g_asset_job_count = 0;
+    add_asset_job(ASSET_TYPE_TIMBRE, "timbres/neiro0.txt", 0, NULL, NULL);
+    add_asset_job(ASSET_TYPE_TIMBRE, "timbres/neiro1.txt", 1, NULL, NULL);
+    add_asset_job(ASSET_TYPE_TIMBRE, "timbres/neiro2.txt", 2, NULL, NULL);
+    add_asset_job(ASSET_TYPE_TIMBRE, "timbres/neiro3.txt", 3, NULL, NULL);
+    add_asset_job(ASSET_TYPE_SEQUENCE, "gakufu/kirakira.txt", 0, NULL, NULL);
+    add_asset_job(ASSET_TYPE_MODEL, "object/Body.obj", 0, &g_model_piano_body, NULL);
+    add_asset_job(ASSET_TYPE_MODEL, "object/WhiteKey.obj", 0, &g_model_white_key, NULL);
+    add_asset_job(ASSET_TYPE_MODEL, "object/BlackKey.obj", 0, &g_model_black_key, NULL);
+    add_asset_job(ASSET_TYPE_MODEL, "object/Botton.obj", 0, &g_model_timbre_button, NULL);
+    add_asset_job(ASSET_TYPE_MODEL, "object/Botton2.obj", 0, &g_model_octave_button, NULL);
+    add_asset_job(ASSET_TYPE_TEXTURE, "textures/tile.ppm", 0, NULL, &g_texture_wood);
+
+    g_is_loading_assets = 1;
+    g_loaded_asset_count = 0;
+    g_loading_start_time_s = ma_timer_get_time_in_seconds(&g_monotonic_timer);
+    ma_atomic_store_explicit_32(&g_next_asset_job, 0, ma_atomic_memory_order_relaxed);
+
+    g_asset_loader_thread_count = 0;
+    for (int i = 0; i < ASSET_LOADER_THREAD_COUNT && i < g_asset_job_count; ++i) {
+        if (ma_thread_create(&g_asset_loader_threads[i], ma_thread_priority_normal, 0, asset_loader_thread, NULL, NULL) != MA_SUCCESS) {
+            fprintf(stderr, "警告: 読み込みスレッドを作成できません。残りはメインスレッドで読み込みます。\n");
+            break;
+        }
+        g_asset_loader_thread_count++;
+    }
+    printf("情報: %d 個のファイルを %d スレッドで読み込んでいます...\n", g_asset_job_count, g_asset_loader_thread_count);
+
+    glutTimerFunc(LOADING_POLL_MS, on_loading_timer, 0);
+}
+
+void add_asset_job(asset_type_e type, const char* filename, int timbre_index, model_3d_t* model, GLuint* texture) {
+    if (g_asset_job_count >= ASSET_JOB_MAX) return;
+
+    asset_job_t* job = &g_asset_jobs[g_asset_job_count++];
+    memset(job, 0, sizeof(*job));
+    job->type = type;
+    job->filename = filename;
+    job->timbre_index = timbre_index;
+    job->model = model;
+    job->texture = texture;
+}
+
+ma_thread_result MA_THREADCALL asset_loader_thread(void* data) {
+    (void)data;
+    while (run_next_asset_job()) {
+    }
+    return (ma_thread_result)0;
+}
+
+// 未着手の仕事を1つ取り出してGLを使わない部分 (ファイル解析) を実行する。仕事が残っていなければ0を返す
+int run_next_asset_job() {
+    ma_uint32 job_index = ma_atomic_fetch_add_explicit_32(&g_next_asset_job, 1, ma_atomic_memory_order_relaxed);
+    if (job_index >= (ma_uint32)g_asset_job_count) return 0;
+
+    asset_job_t* job = &g_asset_jobs[job_index];
+    switch (job->type) {
+    case ASSET_TYPE_TIMBRE:
+        load_timbre_file(job->filename, job->timbre_index);
+        job->is_loaded = 1;
+        break;
+    case ASSET_TYPE_SEQUENCE:
+        load_sequence_file(job->filename, SEQUENCE_DEFAULT_TEMPO);
+        job->is_loaded = 1;
+        break;
+    case ASSET_TYPE_MODEL:
+        job->is_loaded = load_obj_model(job->filename, &job->mesh);
+        break;
+    case ASSET_TYPE_TEXTURE:
+        job->is_loaded = load_ppm_texture(job->filename, &job->image);
+        break;
+    }
+    ma_atomic_store_explicit_32(&job->is_finished, 1, ma_atomic_memory_order_release);
+    return 1;
+}
+
+// メインスレッド (GLコンテキストを持つスレッド) で解析結果をGPUへ転送する
+void upload_asset_job(asset_job_t* job) {
+    if (job->is_loaded) {
+        if (job->type == ASSET_TYPE_MODEL) {
+            upload_model_mesh(job->model, &job->mesh);
+            free_mesh_data(&job->mesh);
+        }
+        else if (job->type == ASSET_TYPE_TEXTURE) {
+            *job->texture = upload_texture_image(&job->image);
+            free_image_data(&job->image);
+        }
+    }
+    job->is_uploaded = 1;
+    g_loaded_asset_count++;
+}
+
+void on_loading_timer(int timer_value) {
+    // スレッドを作れなかった場合は1回につき1つずつ読み込み、進捗表示を更新できるようにする
+    if (g_asset_loader_thread_count == 0) run_next_asset_job();
+
+    int are_timbres_ready = 1;
+    for (int i = 0; i < g_asset_job_count; ++i) {
+        asset_job_t* job = &g_asset_jobs[i];
+        if (!job->is_uploaded && ma_atomic_load_explicit_32(&job->is_finished, ma_atomic_memory_order_acquire)) {
+            upload_asset_job(job);
+        }
+        if (job->type == ASSET_TYPE_TIMBRE && !job->is_uploaded) are_timbres_ready = 0;
+    }
+
+    if (are_timbres_ready && !g_is_audio_started) {
+        // SIMDカーネルの検証には読み込んだウェーブテーブルを使うため、音色がそろってから選ぶ
+        select_voice_render_kernel();
+        g_is_audio_started = start_audio_device();
+        if (g_is_audio_started) {
+            printf("情報: 音色の読み込みが完了したため、音声出力を開始しました (%.3f 秒)。\n",
+                ma_timer_get_time_in_seconds(&g_monotonic_timer) - g_loading_start_time_s);
+        }
+    }
+
+    request_redisplay();
+    if (g_loaded_asset_count < g_asset_job_count) {
+        glutTimerFunc(LOADING_POLL_MS, on_loading_timer, timer_value + 1);
+    }
+    else {
+        finish_asset_loading();
+    }
+}
+
+// 全てのモデルがそろってからシーンオブジェクト (当たり判定・BVH) を構築する
+void finish_asset_loading() {
+    for (int i = 0; i < g_asset_loader_thread_count; ++i) {
+        ma_thread_wait(&g_asset_loader_threads[i]);
+    }
+    g_asset_loader_thread_count = 0;
+
+    initialize_scene_objects();
+    g_is_loading_assets = 0;
+    update_hovered_object();
+    request_redisplay();
+    printf("初期化が完了しました (%.3f 秒)。\n", ma_timer_get_time_in_seconds(&g_monotonic_timer) - g_loading_start_time_s);
+}
+
+int start_audio_device() {
+    ma_context* context = NULL;
+    if (g_audio_config.has_backend) {
+        if (ma_context_init(&g_audio_config.backend, 1, NULL, &g_audio_context) != MA_SUCCESS) {
+            fprintf(stderr, "エラー: オーディオバックエンド '%s' を初期化できません。\n", ma_get_backend_name(g_audio_config.backend));
+            return 0;
+        }
+        g_is_audio_context_initialized = 1;
+        context = &g_audio_context;
+    }
+
+    ma_device_config device_config = ma_device_config_init(ma_device_type_playback);
+    device_config.playback.format = ma_format_f32;
+    device_config.playback.channels = 2;
+    device_config.sampleRate = g_audio_config.sample_rate;
+    device_config.periodSizeInFrames = g_audio_config.period_frames;
+    device_config.periods = g_audio_config.period_count;
+    device_config.performanceProfile = g_audio_config.performance_profile;
+    device_config.dataCallback = audio_callback;
+
+    if (ma_device_init(context, &device_config, &g_audio_device) != MA_SUCCESS) {
+        fprintf(stderr, "エラー: 再生デバイスの初期化に失敗しました。\n");
+        if (g_is_audio_context_initialized) ma_context_uninit(&g_audio_context);
+        g_is_audio_context_initialized = 0;
+        return 0;
+    }
+    start_render_workers();
+    if (g_render_ahead_ms > 0 && !start_render_ahead(g_audio_device.playback.internalPeriodSizeInFrames, g_audio_device.playback.internalPeriods)) {
+        fprintf(stderr, "警告: 先行合成を開始できません。コールバック内で直接合成します。\n");
+    }
+    if (ma_device_start(&g_audio_device) != MA_SUCCESS) {
+        fprintf(stderr, "エラー: 再生デバイスの開始に失敗しました。\n");
+        stop_audio_device();
+        return 0;
+    }
+    report_audio_device();
+    return 1;
+}
+
+void stop_audio_device() {
+    ma_device_uninit(&g_audio_device);
+    stop_render_ahead();
+    stop_render_workers();
+    if (g_is_audio_context_initialized) ma_context_uninit(&g_audio_context);
+    g_is_audio_context_initialized = 0;
+}
+
+// 実際に確保された周期から、打鍵してから音が出るまでの遅延の内訳を求めて表示する
+void report_audio_device() {
+    ma_uint32 internal_sample_rate = g_audio_device.playback.internalSampleRate;
+    ma_uint32 period_frames = g_audio_device.playback.internalPeriodSizeInFrames;
+    ma_uint32 period_count = g_audio_device.playback.internalPeriods;
+    double period_ms = internal_sample_rate > 0 ? period_frames * 1.0e3 / internal_sample_rate : 0.0;
+    double render_ahead_ms = g_render_ahead_frames * 1.0e3 / g_audio_config.sample_rate;
+
+    // 打鍵イベントは次の合成まで最大1周期 (先行合成時は1チャンク) 待ち、合成した音は先行分とデバイスのバッファを経て再生される
+    g_event_wait_ms = g_render_ahead_frames > 0 ? RENDER_AHEAD_CHUNK_FRAMES * 1.0e3 / g_audio_config.sample_rate : period_ms;
+    g_output_latency_ms = render_ahead_ms + period_ms * period_count;
+
+    printf("情報: 再生デバイス '%s' (バックエンド: %s)\n", g_audio_device.playback.name, ma_get_backend_name(g_audio_device.pContext->backend));
+    printf("情報: サンプルレート %u Hz (デバイス側 %u Hz)、周期 %u フレーム (%.2f ms) × %u、%s\n",
+        g_audio_device.sampleRate, internal_sample_rate, period_frames, period_ms, period_count,
+        g_audio_config.performance_profile == ma_performance_profile_low_latency ? "低遅延プロファイル" : "安定重視プロファイル");
+    printf("情報: 推定遅延 (入力→発音): 最大 %.2f ms = 合成待ち %.2f ms + 先行合成 %.2f ms + デバイスバッファ %.2f ms\n",
+        g_event_wait_ms + g_output_latency_ms, g_event_wait_ms, render_ahead_ms, period_ms * period_count);
+}
+
+
+// ============================================================================
+// データ読み込み
+// ============================================================================
+
+// OBJファイルをメモリマップして1回だけ走査し、三角形をマテリアル順に並べ替えてから頂点を重複排除する。
+// GLは使わないため、ワーカースレッドから呼び出せる
+int load_obj_model(const char* filename, mesh_data_t* mesh) {
+    memset(mesh, 0, sizeof(*mesh));
+    char cache_filename[FILE_PATH_MAX];
+    sprintf_s(cache_filename, sizeof(cache_filename), "%s%s", filename, MESH_CACHE_EXTENSION);
+    if (load_mesh_cache(cache_filename, filename, mesh)) return 1;
+
+    mapped_file_t obj_file;
+    if (!map_file(filename, &obj_file)) {
+        fprintf(stderr, "エラー: モデルファイル '%s' を開けません。\n", filename);
+        return 0;
+    }
+
+    obj_parse_state_t state;
+    int is_parsed = parse_obj_buffer((const char*)obj_file.data, obj_file.size, filename, &state);
+    unmap_file(&obj_file);
+    if (!is_parsed) {
+        free_obj_parse_state(&state);
+        return 0;
+    }
+    mesh->local_bbox = state.bbox;
+
+    // 三角形をマテリアルごとに数え、マテリアル順 (マテリアルなしを先頭) に並べる
+    int triangle_count = state.corner_count / 3;
+    int slot_count = state.material_count + 1;
+    int* slot_starts = (int*)calloc(slot_count + 1, sizeof(int));
+    int* triangle_order = (int*)malloc(sizeof(int) * (triangle_count > 0 ? triangle_count : 1));
+    int corner_capacity = triangle_count * 3;
+    int hash_size = 1;
+    while (hash_size < corner_capacity * 2) hash_size <<= 1;
+
+    mesh_vertex_t* mesh_vertices = (mesh_vertex_t*)malloc(sizeof(mesh_vertex_t) * (corner_capacity > 0 ? corner_capacity : 1));
+    int(*vertex_keys)[3] = malloc(sizeof(int[3]) * (corner_capacity > 0 ? corner_capacity : 1));
+    GLuint* indices = (GLuint*)malloc(sizeof(GLuint) * (corner_capacity > 0 ? corner_capacity : 1));
+    int* hash_table = (int*)malloc(sizeof(int) * hash_size);
+    mesh->submeshes = (model_submesh_t*)calloc(slot_count, sizeof(model_submesh_t));
+    int mesh_vertex_count = 0, index_count = 0;
+    int is_built = 0;
+
+    if (!slot_starts || !triangle_order || !mesh_vertices || !vertex_keys || !indices || !hash_table || !mesh->submeshes) {
+        fprintf(stderr, "エラー: メッシュバッファのメモリ確保に失敗しました。\n");
+        free(mesh->submeshes);
+        mesh->submeshes = NULL;
+    }
+    else {
+        for (int t = 0; t < triangle_count; ++t) slot_starts[state.triangle_materials[t] + 2]++;
+        for (int slot = 0; slot < slot_count; ++slot) slot_starts[slot + 1] += slot_starts[slot];
+        for (int t = 0; t < triangle_count; ++t) triangle_order[slot_starts[state.triangle_materials[t] + 1]++] = t;
+
+        // 面の各頂点 (v/vt/vn の組) を重複なしの頂点配列とインデックス配列に変換する
+        memset(hash_table, -1, sizeof(int) * hash_size);
+        int order_index = 0;
+        for (int slot = 0; slot < slot_count; ++slot) {
+            int first_index = index_count;
+            for (; order_index < slot_starts[slot]; ++order_index) {
+                int (*corners)[3] = &state.corners[triangle_order[order_index] * 3];
+                if (corners[0][0] < 1 || corners[0][0] > state.position_count ||
+                    corners[1][0] < 1 || corners[1][0] > state.position_count ||
+                    corners[2][0] < 1 || corners[2][0] > state.position_count) continue;
+                for (int i = 0; i < 3; ++i) {
+                    indices[index_count++] = (GLuint)find_or_add_mesh_vertex(hash_table, hash_size - 1, vertex_keys, mesh_vertices, &mesh_vertex_count,
+                        corners[i], state.positions, state.normals, state.normal_count, state.tex_coords, state.tex_coord_count);
+                }
+            }
+            if (index_count == first_index) continue;
+
+            model_submesh_t* submesh = &mesh->submeshes[mesh->submesh_count++];
+            if (slot == 0) {
+                model_material_t default_material = { "", { 0.2f, 0.2f, 0.2f, 1.0f }, { 0.8f, 0.8f, 0.8f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.0f };
+                submesh->material = default_material;
+            }
+            else {
+                submesh->material = state.materials[slot - 1];
+            }
+            submesh->first_index = first_index;
+            submesh->index_count = index_count - first_index;
+        }
+        mesh->vertices = mesh_vertices;
+        mesh->vertex_count = mesh_vertex_count;
+        mesh->indices = indices;
+        mesh->index_count = index_count;
+        mesh_vertices = NULL;
+        indices = NULL;
+        write_mesh_cache(cache_filename, filename, mesh);
+        is_built = 1;
+    }
+
+    printf("情報: モデル '%s' を読み込みました (頂点: %d, 法線: %d, UV: %d, 面: %d, マテリアル: %d, バッファ頂点: %d, インデックス: %d)。\n",
+        filename, state.position_count, state.normal_count, state.tex_coord_count, state.face_count,
+        state.material_count, mesh_vertex_count, index_count);
+    if (state.malformed_line_count > 0) {
+        fprintf(stderr, "警告: '%s' の解釈できない行 %d 行を無視しました。\n", filename, state.malformed_line_count);
+    }
+
+    free(slot_starts);
+    free(triangle_order);
+    free(mesh_vertices);
+    free(vertex_keys);
+    free(indices);
+    free(hash_table);
+    free_obj_parse_state(&state);
+    return is_built;
+}
+
+// メインスレッドでVBO/IBOへ転送し、マテリアル範囲をモデルへ引き渡す
+void upload_model_mesh(model_3d_t* model, mesh_data_t* mesh) {
+    model->local_bbox = mesh->local_bbox;
+    upload_model_buffers(model, mesh->vertices, mesh->vertex_count, mesh->indices, mesh->index_count);
+    model->submeshes = mesh->submeshes;
+    model->submesh_count = mesh->submesh_count;
+    mesh->submeshes = NULL;
+    mesh->submesh_count = 0;
+}
+
+void free_mesh_data(mesh_data_t* mesh) {
+    if (mesh->cache_file.data != NULL) {
+        unmap_file(&mesh->cache_file);
+    }
+    else {
+        free((void*)mesh->vertices);
+        free((void*)mesh->indices);
+    }
+    free(mesh->submeshes);
+    memset(mesh, 0, sizeof(*mesh));
+}
+
+// 1行ずつ先頭のキーワードで振り分ける。面はその場で扇形に三角形分割し、負のインデックスは現在の要素数から解決する
+int parse_obj_buffer(const char* data, size_t size, const char* obj_filename, obj_parse_state_t* state) {
+    memset(state, 0, sizeof(*state));
+    state->current_material = -1;
+    state->bbox.min = (vector_3d_t){ 1e9, 1e9, 1e9 };
+    state->bbox.max = (vector_3d_t){ -1e9, -1e9, -1e9 };
+
+    const char* end = data + size;
+    const char* line = data;
+    while (line < end && !state->is_out_of_memory) {
+        const char* line_end = (const char*)memchr(line, '\n', (size_t)(end - line));
+        if (line_end == NULL) line_end = end;
+
+        const char* cursor = skip_spaces(line, line_end);
+        const char* keyword = cursor;
+        while (cursor < line_end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r') cursor++;
+        size_t keyword_length = (size_t)(cursor - keyword);
+        cursor = skip_spaces(cursor, line_end);
+
+        if (keyword_length == 1 && keyword[0] == 'v') {
+            float x, y, z;
+            const char* next = scan_float(cursor, line_end, &x);
+            if (next) next = scan_float(skip_spaces(next, line_end), line_end, &y);
+            if (next) next = scan_float(skip_spaces(next, line_end), line_end, &z);
+            if (!next) {
+                state->malformed_line_count++;
+            }
+            else if (grow_array((void**)&state->positions, &state->position_capacity, state->position_count + 1, sizeof(float[3]))) {
+                float* position = state->positions[state->position_count++];
+                position[0] = x; position[1] = y; position[2] = z;
+                if (x < state->bbox.min.x) state->bbox.min.x = x;
+                if (x > state->bbox.max.x) state->bbox.max.x = x;
+                if (y < state->bbox.min.y) state->bbox.min.y = y;
+                if (y > state->bbox.max.y) state->bbox.max.y = y;
+                if (z < state->bbox.min.z) state->bbox.min.z = z;
+                if (z > state->bbox.max.z) state->bbox.max.z = z;
+            }
+            else {
+                state->is_out_of_memory = 1;
+            }
+        }
+        else if (keyword_length == 2 && keyword[0] == 'v' && keyword[1] == 'n') {
+            float x, y, z;
+            const char* next = scan_float(cursor, line_end, &x);
+            if (next) next = scan_float(skip_spaces(next, line_end), line_end, &y);
+            if (next) next = scan_float(skip_spaces(next, line_end), line_end, &z);
+            if (!next) {
+                state->malformed_line_count++;
+            }
+            else if (grow_array((void**)&state->normals, &state->normal_capacity, state->normal_count + 1, sizeof(float[3]))) {
+                float* normal = state->normals[state->normal_count++];
+                normal[0] = x; normal[1] = y; normal[2] = z;
+            }
+            else {
+                state->is_out_of_memory = 1;
+            }
+        }
+        else if (keyword_length == 2 && keyword[0] == 'v' && keyword[1] == 't') {
+            // 3番目の成分 (w) は使わない
+            float u, v = 0.0f;
+            const char* next = scan_float(cursor, line_end, &u);
+            if (next) {
+                const char* next_v = scan_float(skip_spaces(next, line_end), line_end, &v);
+                if (!next_v) v = 0.0f;
+            }
+            if (!next) {
+                state->malformed_line_count++;
+            }
+            else if (grow_array((void**)&state->tex_coords, &state->tex_coord_capacity, state->tex_coord_count + 1, sizeof(float[2]))) {
+                float* tex_coord = state->tex_coords[state->tex_coord_count++];
+                tex_coord[0] = u; tex_coord[1] = v;
+            }
+            else {
+                state->is_out_of_memory = 1;
+            }
+        }
+        else if (keyword_length == 1 && keyword[0] == 'f') {
+            parse_obj_face(state, cursor, line_end);
+        }
+        else if (keyword_length == 6 && strncmp(keyword, "usemtl", 6) == 0) {
+            state->current_material = find_obj_material(state, cursor, trim_line_length(cursor, line_end));
+        }
+        else if (keyword_length == 6 && strncmp(keyword, "mtllib", 6) == 0) {
+            // .mtl ファイルはOBJファイルと同じディレクトリから探す
+            size_t name_length = trim_line_length(cursor, line_end);
+            const char* separator = strrchr(obj_filename, '/');
+            const char* backslash = strrchr(obj_filename, '\\');
+            if (backslash && (!separator || backslash > separator)) separator = backslash;
+            int directory_length = separator ? (int)(separator - obj_filename + 1) : 0;
+            char mtl_filename[FILE_PATH_MAX];
+            if (name_length > 0 && directory_length + name_length < sizeof(mtl_filename)) {
+                sprintf_s(mtl_filename, sizeof(mtl_filename), "%.*s%.*s", directory_length, obj_filename, (int)name_length, cursor);
+                load_mtl_file(mtl_filename, state);
+            }
+        }
+        line = line_end + 1;
+    }
+
+    if (state->is_out_of_memory) {
+        fprintf(stderr, "エラー: モデルデータのメモリ確保に失敗しました。\n");
+        return 0;
+    }
+    if (state->position_count == 0) {
+        fprintf(stderr, "エラー: '%s' に頂点データがありません。\n", obj_filename);
+        return 0;
+    }
+    return 1;
+}
+
+// f の各要素は v, v/vt, v//vn, v/vt/vn のいずれか。多角形は最初の頂点を中心とした扇形に分割する
+void parse_obj_face(obj_parse_state_t* state, const char* cursor, const char* line_end) {
+    int first_key[3], previous_key[3];
+    int corner_index = 0;
+    int first_corner = state->corner_count;     // 途中で不正な要素があれば面全体を取り消す
+
+    for (cursor = skip_spaces(cursor, line_end); cursor < line_end && *cursor != '\r'; cursor = skip_spaces(cursor, line_end)) {
+        int key[3] = { 0, 0, 0 };
+        const int element_counts[3] = { state->position_count, state->tex_coord_count, state->normal_count };
+
+        cursor = scan_int(cursor, line_end, &key[0]);
+        if (cursor && cursor < line_end && *cursor == '/') {
+            cursor++;
+            if (cursor < line_end && *cursor != '/') cursor = scan_int(cursor, line_end, &key[1]);
+            if (cursor && cursor < line_end && *cursor == '/') cursor = scan_int(cursor + 1, line_end, &key[2]);
+        }
+        if (!cursor || (cursor < line_end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r')) {
+            state->corner_count = first_corner;
+            state->malformed_line_count++;
+            return;
+        }
+        for (int i = 0; i < 3; ++i) {
+            if (key[i] < 0) key[i] += element_counts[i] + 1;
+        }
+
+        if (corner_index == 0) {
+            memcpy(first_key, key, sizeof(first_key));
+        }
+        else if (corner_index >= 2) {
+            int triangle_index = state->corner_count / 3;
+            if (!grow_array((void**)&state->corners, &state->corner_capacity, state->corner_count + 3, sizeof(int[3])) ||
+                !grow_array((void**)&state->triangle_materials, &state->triangle_capacity, triangle_index + 1, sizeof(int))) {
+                state->is_out_of_memory = 1;
+                return;
+            }
+            memcpy(state->corners[state->corner_count++], first_key, sizeof(first_key));
+            memcpy(state->corners[state->corner_count++], previous_key, sizeof(previous_key));
+            memcpy(state->corners[state->corner_count++], key, sizeof(key));
+            state->triangle_materials[triangle_index] = state->current_material;
+        }
+        memcpy(previous_key, key, sizeof(previous_key));
+        corner_index++;
+    }
+
+    if (corner_index >= 3) state->face_count++;
+    else state->malformed_line_count++;
+}
+
+// newmtl ごとに Ka/Kd/Ks/Ns を読み込む。同じ名前のマテリアルは後から定義されたもので上書きする
+void load_mtl_file(const char* filename, obj_parse_state_t* state) {
+    mapped_file_t mtl_file;
+    if (!map_file(filename, &mtl_file)) {
+        fprintf(stderr, "警告: マテリアルファイル '%s' を開けません。\n", filename);
+        return;
+    }
+
+    const char* end = (const char*)mtl_file.data + mtl_file.size;
+    const char* line = (const char*)mtl_file.data;
+    model_material_t* material = NULL;
+    while (line < end) {
+        const char* line_end = (const char*)memchr(line, '\n', (size_t)(end - line));
+        if (line_end == NULL) line_end = end;
+
+        const char* cursor = skip_spaces(line, line_end);
+        const char* keyword = cursor;
+        while (cursor < line_end && *cursor != ' ' && *cursor != '\t' && *cursor != '\r') cursor++;
+        size_t keyword_length = (size_t)(cursor - keyword);
+        cursor = skip_spaces(cursor, line_end);
+
+        if (keyword_length == 6 && strncmp(keyword, "newmtl", 6) == 0) {
+            size_t name_length = trim_line_length(cursor, line_end);
+            if (name_length >= MATERIAL_NAME_MAX) name_length = MATERIAL_NAME_MAX - 1;
+            int material_index = find_obj_material(state, cursor, name_length);
+            if (material_index < 0) {
+                if (!grow_array((void**)&state->materials, &state->material_capacity, state->material_count + 1, sizeof(model_material_t))) {
+                    state->is_out_of_memory = 1;
+                    break;
+                }
+                material_index = state->material_count++;
+            }
+            material = &state->materials[material_index];
+            model_material_t default_material = { "", { 0.2f, 0.2f, 0.2f, 1.0f }, { 0.8f, 0.8f, 0.8f, 1.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, 0.0f };
+            *material = default_material;
+            memcpy(material->name, cursor, name_length);
+            material->name[name_length] = '\0';
+        }
+        else if (material && keyword_length == 2 && keyword[0] == 'K' && (keyword[1] == 'a' || keyword[1] == 'd' || keyword[1] == 's')) {
+            GLfloat* color = (keyword[1] == 'a') ? material->ambient : (keyword[1] == 'd') ? material->diffuse : material->specular;
+            float r, g, b;
+            const char* next = scan_float(cursor, line_end, &r);
+            if (next) next = scan_float(skip_spaces(next, line_end), line_end, &g);
+            if (next) next = scan_float(skip_spaces(next, line_end), line_end, &b);
+            if (next) {
+                color[0] = r; color[1] = g; color[2] = b;
+            }
+        }
+        else if (material && keyword_length == 2 && keyword[0] == 'N' && keyword[1] == 's') {
+            // OBJの Ns (0〜1000) をOpenGLの鏡面指数 (0〜128) に換算する
+            float shininess;
+            if (scan_float(cursor, line_end, &shininess)) {
+                material->shininess = shininess * 128.0f / 1000.0f;
+            }
+        }
+        line = line_end + 1;
+    }
+    unmap_file(&mtl_file);
+}
+
+int find_obj_material(const obj_parse_state_t* state, const char* name, size_t name_length) {
+    if (name_length >= MATERIAL_NAME_MAX) name_length = MATERIAL_NAME_MAX - 1;
+    for (int i = 0; i < state->material_count; ++i) {
+        if (strlen(state->materials[i].name) == name_length && strncmp(state->materials[i].name, name, name_length) == 0) return i;
+    }
+    return -1;
+}
+
+void free_obj_parse_state(obj_parse_state_t* state) {
+    free(state->positions);
+    free(state->normals);
+    free(state->tex_coords);
+    free(state->corners);
+    free(state->triangle_materials);
+    free(state->materials);
+    memset(state, 0, sizeof(*state));
+}
+
+// v/vt/vn の組をハッシュ表で検索し、未登録なら頂点を追加してそのインデックスを返す
+int find_or_add_mesh_vertex(int* hash_table, int hash_mask, int (*vertex_keys)[3], mesh_vertex_t* mesh_vertices, int* mesh_vertex_count,
+    const int key[3], float (*vertices)[3], float (*normals)[3], int normal_count, float (*tex_coords)[2], int tex_coord_count) {
+    unsigned int hash = (unsigned int)key[0] * 73856093u ^ (unsigned int)key[1] * 19349663u ^ (unsigned int)key[2] * 83492791u;
+    int slot = (int)(hash & (unsigned int)hash_mask);
+
+    while (hash_table[slot] >= 0) {
+        int* existing = vertex_keys[hash_table[slot]];
+        if (existing[0] == key[0] && existing[1] == key[1] && existing[2] == key[2]) {
+            return hash_table[slot];
+        }
+        slot = (slot + 1) & hash_mask;
+    }
+
+    int index = (*mesh_vertex_count)++;
+    mesh_vertex_t* vertex = &mesh_vertices[index];
+    memcpy(vertex_keys[index], key, sizeof(int[3]));
+    memcpy(vertex->position, vertices[key[0] - 1], sizeof(vertex->position));
+
+    // 範囲外の法線・UVは既定値で補う
+    if (key[2] >= 1 && key[2] <= normal_count) {
+        memcpy(vertex->normal, normals[key[2] - 1], sizeof(vertex->normal));
+    }
+    else {
+        vertex->normal[0] = 0.0f; vertex->normal[1] = 1.0f; vertex->normal[2] = 0.0f;
+    }
+    if (key[1] >= 1 && key[1] <= tex_coord_count) {
+        memcpy(vertex->tex_coord, tex_coords[key[1] - 1], sizeof(vertex->tex_coord));
+    }
+    else {
+        vertex->tex_coord[0] = 0.0f; vertex->tex_coord[1] = 0.0f;
+    }
+
+    hash_table[slot] = index;
+    return index;
+}
+
+void upload_model_buffers(model_3d_t* model, const mesh_vertex_t* vertices, int vertex_count, const GLuint* indices, int index_count) {
+    if (vertex_count == 0 || index_count == 0) return;
+
+    // VAOが使えれば頂点配列の設定をまとめて記録し、描画時はバインドだけで済ませる
+    if (GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object) {
+        glGenVertexArrays(1, &model->vertex_array_id);
+        glBindVertexArray(model->vertex_array_id);
+    }
+
+    glGenBuffers(1, &model->vertex_buffer_id);
+    glBindBuffer(GL_ARRAY_BUFFER, model->vertex_buffer_id);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(mesh_vertex_t) * vertex_count, vertices, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &model->index_buffer_id);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->index_buffer_id);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * index_count, indices, GL_STATIC_DRAW);
+    model->index_count = index_count;
+
+    if (model->vertex_array_id != 0) {
+        set_model_vertex_arrays(1);
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// キャッシュをメモリマップし、元のOBJと一致すればマップしたまま頂点・インデックスを指す (転送までコピーしない)
+int load_mesh_cache(const char* cache_filename, const char* source_filename, mesh_data_t* mesh) {
+    ma_uint64 source_size;
+    ma_int64 source_mtime;
+    if (!get_file_stamp(source_filename, &source_size, &source_mtime)) return 0;
+    // マップ中のファイルには書き込めないため、ヘッダーの更新時刻の書き換えはマップ前に済ませる
+    int is_source_matched = check_mesh_cache_source(cache_filename, source_filename, source_size, source_mtime);
+
+    mapped_file_t cache_file;
+    if (!map_file(cache_filename, &cache_file)) return 0;
+
+    int is_valid = 0;
+    const mesh_cache_header_t* header = (const mesh_cache_header_t*)cache_file.data;
+    if (cache_file.size >= sizeof(mesh_cache_header_t) &&
+        header->magic == MESH_CACHE_MAGIC && header->version == MESH_CACHE_VERSION &&
+        header->vertex_size == sizeof(mesh_vertex_t) && header->source_size == source_size &&
+        cache_file.size == sizeof(mesh_cache_header_t) + (size_t)header->vertex_count * sizeof(mesh_vertex_t) +
+            (size_t)header->index_count * sizeof(GLuint) + (size_t)header->submesh_count * sizeof(model_submesh_t)) {
+        is_valid = is_source_matched;
+    }
+
+    const mesh_vertex_t* vertices = (const mesh_vertex_t*)(cache_file.data + sizeof(mesh_cache_header_t));
+    const GLuint* indices = NULL;
+    const model_submesh_t* submeshes = NULL;
+    if (is_valid) {
+        indices = (const GLuint*)(vertices + header->vertex_count);
+        submeshes = (const model_submesh_t*)(indices + header->index_count);
+        for (ma_uint32 i = 0; i < header->submesh_count; ++i) {
+            if (submeshes[i].first_index < 0 || submeshes[i].index_count < 0 ||
+                (ma_uint64)submeshes[i].first_index + (ma_uint64)submeshes[i].index_count > header->index_count) {
+                is_valid = 0;
+            }
+        }
+        for (ma_uint32 i = 0; i < header->index_count; ++i) {
+            if (indices[i] >= header->vertex_count) {
+                is_valid = 0;
+                break;
+            }
+        }
+    }
+
+    if (is_valid && header->submesh_count > 0) {
+        mesh->submeshes = (model_submesh_t*)malloc(sizeof(model_submesh_t) * header->submesh_count);
+        if (mesh->submeshes == NULL) {
+            is_valid = 0;
+        }
+        else {
+            memcpy(mesh->submeshes, submeshes, sizeof(model_submesh_t) * header->submesh_count);
+            mesh->submesh_count = (int)header->submesh_count;
+        }
+    }
+
+    if (!is_valid) {
+        printf("情報: メッシュキャッシュ '%s' が古いか壊れているため、'%s' から作り直します。\n", cache_filename, source_filename);
+        unmap_file(&cache_file);
+        return 0;
+    }
+    mesh->local_bbox = header->local_bbox;
+    mesh->vertices = vertices;
+    mesh->vertex_count = (int)header->vertex_count;
+    mesh->indices = indices;
+    mesh->index_count = (int)header->index_count;
+    mesh->cache_file = cache_file;
+    printf("情報: メッシュキャッシュ '%s' を読み込みました (バッファ頂点: %u, インデックス: %u)。\n",
+        cache_filename, header->vertex_count, header->index_count);
+    return 1;
+}
+
+// キャッシュのヘッダーだけを読み、元のOBJと同じ内容から作られたかを返す。更新時刻が違っても内容のハッシュが
+// 一致すれば有効とみなし (チェックアウトし直した場合など)、ヘッダーの更新時刻を書き換えて次回からハッシュ計算を省く
+int check_mesh_cache_source(const char* cache_filename, const char* source_filename, ma_uint64 source_size, ma_int64 source_mtime) {
+    FILE* file;
+    if (fopen_s(&file, cache_filename, "rb") != 0 || file == NULL) return 0;
+    mesh_cache_header_t header;
+    int is_read = fread(&header, sizeof(header), 1, file) == 1;
+    fclose(file);
+    if (!is_read || header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || header.source_size != source_size) return 0;
+    if (header.source_mtime == source_mtime) return 1;
+
+    mapped_file_t source_file;
+    if (!map_file(source_filename, &source_file)) return 0;
+    int is_matched = (hash_bytes(source_file.data, source_file.size) == header.source_hash);
+    unmap_file(&source_file);
+    if (!is_matched) return 0;
+
+    // 書き換えに失敗しても内容は一致しているので有効のまま (次回もハッシュで確かめる)
+    header.source_mtime = source_mtime;
+    if (fopen_s(&file, cache_filename, "r+b") == 0 && file != NULL) {
+        int is_written = fwrite(&header, sizeof(header), 1, file) == 1;
+        is_written = (fclose(file) == 0) && is_written;
+        if (is_written) {
+            printf("情報: メッシュキャッシュ '%s' の更新時刻を '%s' に合わせました。\n", cache_filename, source_filename);
+        }
+    }
+    return 1;
+}
+
+// 一時ファイルに書き出してから置き換え、書き込み途中のキャッシュが読まれないようにする
+void write_mesh_cache(const char* cache_filename, const char* source_filename, const mesh_data_t* mesh) {
+    if (mesh->vertex_count == 0 || mesh->index_count == 0) return;
+
+    mesh_cache_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.vertex_count = (ma_uint32)mesh->vertex_count;
+    header.index_count = (ma_uint32)mesh->index_count;
+    header.vertex_size = sizeof(mesh_vertex_t);
+    header.submesh_count = (ma_uint32)mesh->submesh_count;
+    header.local_bbox = mesh->local_bbox;
+
+    mapped_file_t source_file;
+    if (!get_file_stamp(source_filename, &header.source_size, &header.source_mtime) || !map_file(source_filename, &source_file)) return;
+    header.source_hash = hash_bytes(source_file.data, source_file.size);
+    unmap_file(&source_file);
+
+    char temp_filename[FILE_PATH_MAX];
+    sprintf_s(temp_filename, sizeof(temp_filename), "%s.tmp", cache_filename);
+    FILE* file;
+    if (fopen_s(&file, temp_filename, "wb") != 0 || file == NULL) {
+        fprintf(stderr, "警告: メッシュキャッシュ '%s' を作成できません。\n", cache_filename);
+        return;
+    }
+    int is_written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(mesh->vertices, sizeof(mesh_vertex_t), mesh->vertex_count, file) == (size_t)mesh->vertex_count &&
+        fwrite(mesh->indices, sizeof(GLuint), mesh->index_count, file) == (size_t)mesh->index_count &&
+        fwrite(mesh->submeshes, sizeof(model_submesh_t), mesh->submesh_count, file) == (size_t)mesh->submesh_count;
+    is_written = (fclose(file) == 0) && is_written;
+
+    remove(cache_filename);
+    if (!is_written || rename(temp_filename, cache_filename) != 0) {
+        fprintf(stderr, "警告: メッシュキャッシュ '%s' の書き込みに失敗しました。\n", cache_filename);
+        remove(temp_filename);
+        return;
+    }
+    printf("情報: メッシュキャッシュ '%s' を作成しました。\n", cache_filename);
+}
+
+void delete_model_buffers(model_3d_t* model) {
+    if (model->vertex_array_id != 0) glDeleteVertexArrays(1, &model->vertex_array_id);
+    if (model->vertex_buffer_id != 0) glDeleteBuffers(1, &model->vertex_buffer_id);
+    if (model->index_buffer_id != 0) glDeleteBuffers(1, &model->index_buffer_id);
+    model->vertex_array_id = 0;
+    model->vertex_buffer_id = 0;
+    model->index_buffer_id = 0;
+    model->index_count = 0;
+    free(model->submeshes);
+    model->submeshes = NULL;
+    model->submesh_count = 0;
+}
+
+// PNM (P6/P5/P3/P2) をメモリマップして読み込む。バイナリ形式で最大値255ならコピーせずマップ内の画素をそのまま転送に使う。
+// ワーカースレッドから呼び出せるよう、GLへの転送は upload_texture_image で行う
+int load_ppm_texture(const char* filename, image_data_t* image) {
+    memset(image, 0, sizeof(*image));
+    if (!map_file(filename, &image->file)) {
+        fprintf(stderr, "エラー: テクスチャファイル '%s' を開けません。\n", filename);
+        return 0;
+    }
+
+    const unsigned char* cursor = image->file.data;
+    const unsigned char* end = image->file.data + image->file.size;
+    char magic = (image->file.size >= 2 && cursor[0] == 'P') ? (char)cursor[1] : '\0';
+    int is_binary = (magic == '6' || magic == '5');
+    image->channel_count = (magic == '6' || magic == '3') ? 3 : 1;
+    if (magic != '6' && magic != '5' && magic != '3' && magic != '2') {
+        fprintf(stderr, "エラー: '%s' はPNM形式 (P6/P5/P3/P2) のファイルではありません。\n", filename);
+        free_image_data(image);
+        return 0;
+    }
+
+    // ヘッダーの各値の間には空白と # コメントが入り得る
+    int max_value = 0;
+    cursor += 2;
+    cursor = scan_pnm_value(cursor, end, &image->width);
+    if (cursor) cursor = scan_pnm_value(cursor, end, &image->height);
+    if (cursor) cursor = scan_pnm_value(cursor, end, &max_value);
+    if (!cursor || image->width <= 0 || image->height <= 0 || max_value <= 0 || max_value > 65535) {
+        fprintf(stderr, "エラー: '%s' のヘッダーが不正です。\n", filename);
+        free_image_data(image);
+        return 0;
+    }
+
+    size_t value_count = (size_t)image->width * image->height * image->channel_count;
+    int bytes_per_value = (max_value > 255) ? 2 : 1;
+    if (is_binary) {
+        // 最大値の後の空白1文字の直後から画素データが始まる。ファイルがそこで終わっていればヘッダーの誤り
+        if (cursor >= end || (*cursor != ' ' && *cursor != '\t' && *cursor != '\n' && *cursor != '\r' && *cursor != '\v' && *cursor != '\f')) {
+            fprintf(stderr, "エラー: '%s' のヘッダーが不正です。\n", filename);
+            free_image_data(image);
+            return 0;
+        }
+        cursor++;
+        if ((size_t)(end - cursor) < value_count * bytes_per_value) {
+            fprintf(stderr, "エラー: '%s' の画素データが不足しています。\n", filename);
+            free_image_data(image);
+            return 0;
+        }
+        if (max_value == 255) {
+            image->pixels = cursor;
+            printf("情報: テクスチャ '%s' を読み込みました (P%c, サイズ: %dx%d)。\n", filename, magic, image->width, image->height);
+            return 1;
+        }
+    }
+
+    // テキスト形式・16bit・最大値が255以外は8bitへ変換する
+    image->converted_pixels = (unsigned char*)malloc(value_count);
+    if (image->converted_pixels == NULL) {
+        fprintf(stderr, "エラー: テクスチャデータのメモリ確保に失敗しました。\n");
+        free_image_data(image);
+        return 0;
+    }
+    for (size_t i = 0; i < value_count; ++i) {
+        int value;
+        if (is_binary) {
+            value = (bytes_per_value == 2) ? (cursor[0] << 8 | cursor[1]) : cursor[0];
+            cursor += bytes_per_value;
+        }
+        else {
+            cursor = scan_pnm_value(cursor, end, &value);
+            if (!cursor) {
+                fprintf(stderr, "エラー: '%s' の画素データが不足しています。\n", filename);
+                free_image_data(image);
+                return 0;
+            }
+        }
+        if (value > max_value) value = max_value;
+        image->converted_pixels[i] = (unsigned char)((value * 255 + max_value / 2) / max_value);
+    }
+    image->pixels = image->converted_pixels;
+    unmap_file(&image->file);
+    printf("情報: テクスチャ '%s' を読み込みました (P%c, 最大値: %d, サイズ: %dx%d)。\n", filename, magic, max_value, image->width, image->height);
+    return 1;
+}
+
+// 空白と # コメントを読み飛ばして10進数を1つ読み取る。数字が無ければ NULL
+const unsigned char* scan_pnm_value(const unsigned char* cursor, const unsigned char* end, int* value) {
+    while (cursor < end) {
+        if (*cursor == '#') {
+            while (cursor < end && *cursor != '\n' && *cursor != '\r') cursor++;
+        }
+        else if (*cursor == ' ' || *cursor == '\t' || *cursor == '\n' || *cursor == '\r' || *cursor == '\v' || *cursor == '\f') {
+            cursor++;
+        }
+        else {
+            break;
+        }
+    }
+    if (cursor >= end || *cursor < '0' || *cursor > '9') return NULL;
+
+    int result = 0;
+    for (; cursor < end && *cursor >= '0' && *cursor <= '9'; ++cursor) {
+        if (result < 100000000) result = result * 10 + (*cursor - '0');
+    }
+    *value = result;
+    return cursor;
+}
+
+// 画素はメモリマップ (または変換バッファ) から直接 glTexImage2D へ渡す。テクスチャは起動時に1回転送するだけなので、
+// 中間のピクセルバッファオブジェクトは使わない (コピーが1回増えるだけで非同期にはならない)。
+// 床は200×200単位に繰り返し貼るため、ミップマップと異方性フィルタリングで遠方のちらつきを抑える
+GLuint upload_texture_image(const image_data_t* image) {
+    GLenum format = (image->channel_count == 3) ? GL_RGB : GL_LUMINANCE;
+    int has_generate_mipmap = GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+    GLuint texture_id;
+
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    if (GLEW_EXT_texture_filter_anisotropic) {
+        GLfloat max_anisotropy = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT,
+            max_anisotropy < TEXTURE_MAX_ANISOTROPY ? max_anisotropy : TEXTURE_MAX_ANISOTROPY);
+    }
+    if (!has_generate_mipmap) {
+        // OpenGL 1.4 の自動生成 (基本レベルの転送時に下位レベルも作られる)
+        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, image->width, image->height, 0, format, GL_UNSIGNED_BYTE, image->pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (has_generate_mipmap) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture_id;
+}
+
+void free_image_data(image_data_t* image) {
+    unmap_file(&image->file);
+    free(image->converted_pixels);
+    memset(image, 0, sizeof(*image));
+}
+
+void load_timbre_file(const char* filename, int timbre_index) {
+    if (timbre_index < 0 || timbre_index >= TIMBRE_BUTTON_COUNT) return;
+
+    FILE* file;
+    timbre_t* timbre = &g_timbres[timbre_index];
+
+    if (fopen_s(&file, filename, "r") != 0 || file == NULL) {
+        fprintf(stderr, "警告: 音色ファイル '%s' を開けません。デフォルト音色を適用します。\n", filename);
+        timbre->harmonic_count = 1;
+        timbre->harmonics = (harmonic_t*)malloc(sizeof(harmonic_t));
+        timbre->harmonics[0] = (harmonic_t){ 1.0f, 0.0f };
+        sprintf_s(timbre->name, sizeof(timbre->name), "Default Sine");
+        build_timbre_wavetables(timbre);
+        return;
+    }
+
+    char name_buffer[64];
+    fgets(name_buffer, sizeof(name_buffer), file);
+    if (sscanf_s(name_buffer, "%63[^\n]", timbre->name, (unsigned)_countof(timbre->name)) != 1) {
+        sprintf_s(timbre->name, sizeof(timbre->name), "Unnamed %d", timbre_index);
+    }
+
+    if (fscanf_s(file, "%d", &timbre->harmonic_count) != 1 || timbre->harmonic_count <= 0) {
+        fprintf(stderr, "エラー: '%s' の倍音数が不正です。\n", filename);
+        fclose(file);
+        return;
+    }
+
+    timbre->harmonics = (harmonic_t*)malloc(sizeof(harmonic_t) * timbre->harmonic_count);
+    if (timbre->harmonics == NULL) {
+        fprintf(stderr, "エラー: 倍音データのメモリ確保に失敗しました。\n");
+        fclose(file);
+        return;
+    }
+    for (int i = 0; i < timbre->harmonic_count; ++i) {
+        if (fscanf_s(file, "%f,%f", &timbre->harmonics[i].amplitude, &timbre->harmonics[i].phase_shift) != 2) {
+            fprintf(stderr, "警告: '%s' の倍音%dの読み込みに失敗しました。\n", filename, i + 1);
+            timbre->harmonics[i] = (harmonic_t){ 0.0f, 0.0f };
+        }
+    }
+
+    fclose(file);
+    build_timbre_wavetables(timbre);
+    printf("情報: 音色 '%s' (%s) を読み込みました (倍音数: %d)。\n", timbre->name, filename, timbre->harmonic_count);
+}
+
+void build_timbre_wavetables(timbre_t* timbre) {
+    const int table_stride = WAVETABLE_SIZE + 1;
+
+    free(timbre->wavetables);
+    timbre->wavetables = (float*)malloc(sizeof(float) * table_stride * WAVETABLE_OCTAVE_COUNT);
+    if (timbre->wavetables == NULL) {
+        fprintf(stderr, "エラー: ウェーブテーブルのメモリ確保に失敗しました。\n");
+        return;
+    }
+
+    for (int octave = 0; octave < WAVETABLE_OCTAVE_COUNT; ++octave) {
+        float* table = &timbre->wavetables[octave * table_stride];
+
+        // オクターブ帯域の最高音でナイキスト周波数を超える倍音は含めない
+        double highest_freq = midi_to_freq(octave * 12 + 11);
+        int harmonic_limit = (int)((g_audio_config.sample_rate / 2.0) / highest_freq);
+        if (harmonic_limit > timbre->harmonic_count) harmonic_limit = timbre->harmonic_count;
+
+        for (int i = 0; i < WAVETABLE_SIZE; ++i) {
+            double phase = 2.0 * M_PI * i / WAVETABLE_SIZE;
+            double sample = 0.0;
+            for (int h = 0; h < harmonic_limit; ++h) {
+                harmonic_t* harmonic = &timbre->harmonics[h];
+                sample += harmonic->amplitude * sin(phase * (h + 1) + harmonic->phase_shift);
+            }
+            table[i] = (float)sample;
+        }
+        table[WAVETABLE_SIZE] = table[0]; // 線形補間用のガードサンプル
+    }
+}
+
+void load_sequence_file(const char* filename, float tempo) {
+    FILE* file;
+    if (fopen_s(&file, filename, "r") != 0 || file == NULL) {
+        fprintf(stderr, "エラー: 楽譜ファイル '%s' を開けません。\n", filename);
+        return;
+    }
+
+    char line[256];
+    g_sequence_length = 0;
+    while (fgets(line, sizeof(line), file)) {
+        if (strlen(line) > 2) g_sequence_length++;
+    }
+    if (g_sequence_length == 0) { fclose(file); return; }
+
+    g_sequence = (sequence_event_t*)malloc(sizeof(sequence_event_t) * g_sequence_length);
+    if (g_sequence == NULL) {
+        fprintf(stderr, "エラー: シーケンスデータのメモリ確保に失敗しました。\n");
+        fclose(file);
+        return;
+    }
+
+    rewind(file);
+    int event_index = 0;
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file) && event_index < g_sequence_length) {
+        line_number++;
+        if (strlen(line) < 3) continue;
+
+        char note_char = line[0];
+        char accidental_char = line[1];
+        int octave = line[2] - '0';
+        char dot_char = line[3];
+        char duration_char = line[4];
+
+        int midi_note = 0;
+        if (note_char == 'M') {
+            midi_note = 0;
+        }
+        else {
+            int base_note = 0;
+            switch (note_char) {
+            case 'C': base_note = 0; break; case 'D': base_note = 2; break;
+            case 'E': base_note = 4; break; case 'F': base_note = 5; break;
+            case 'G': base_note = 7; break; case 'A': base_note = 9; break;
+            case 'B': base_note = 11; break;
+            default: continue;
+            }
+            if (octave < 0 || octave > 9) {
+                fprintf(stderr, "警告: 楽譜の %d 行目のオクターブ '%c' は範囲外のため無視します。\n", line_number, line[2]);
+                continue;
+            }
+            int accidental = (accidental_char == '#') ? 1 : ((accidental_char == 'b') ? -1 : 0);
+            midi_note = 12 + (octave * 12) + base_note + accidental;
+        }
+        g_sequence[event_index].midi_note = midi_note;
+
+        float beat_duration_ms = (60.0f / tempo) * 1000.0f;
+        float base_duration = beat_duration_ms;
+        switch (duration_char) {
+        case '2': base_duration = beat_duration_ms * 4.0f; break;
+        case '3': base_duration = beat_duration_ms * 2.0f; break;
+        case '4': base_duration = beat_duration_ms; break;
+        case '5': base_duration = beat_duration_ms / 2.0f; break;
+        case '6': base_duration = beat_duration_ms / 4.0f; break;
+        case '7': base_duration = beat_duration_ms / 8.0f; break;
+        }
+
+        g_sequence[event_index].duration_ms = (dot_char == '.') ? (base_duration * 1.5f) : base_duration;
+        event_index++;
+    }
+
+    fclose(file);
+    // 読み飛ばした行があれば未初期化のイベントを再生しないよう長さを詰める
+    g_sequence_length = event_index;
+    printf("情報: 楽譜 '%s' を読み込みました (イベント数: %d)。\n", filename, g_sequence_length);
+}
+
+
+// ============================================================================
+// 描画処理
+// ============================================================================
+
+void display() {
+    g_last_frame_time_s = ma_timer_get_time_in_seconds(&g_monotonic_timer);
+    advance_key_animation(g_last_frame_time_s);
+    if (g_hud_font_texture == 0) build_hud_font_atlas();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // 読み込み中はシーンを描かず、HUDの進捗表示だけを出す
+    if (g_is_loading_assets) {
+        draw_hud();
+        glutSwapBuffers();
+        return;
+    }
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(CAMERA_FOV_Y_DEG, (GLfloat)g_window_width / g_window_height, CAMERA_NEAR_PLANE, CAMERA_FAR_PLANE);
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    gluLookAt(g_camera_pos[0], g_camera_pos[1], g_camera_pos[2],
+        g_camera_pos[0] + g_camera_front[0],
+        g_camera_pos[1] + g_camera_front[1],
+        g_camera_pos[2] + g_camera_front[2],
+        g_camera_up[0], g_camera_up[1], g_camera_up[2]);
+
+    GLfloat light_pos[] = { 0.0f, 5.0f, 5.0f, 1.0f };
+    glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
+
+    update_scene_visibility();
+
+    draw_floor();
+    draw_piano_body();
+    draw_piano_keys();
+    draw_buttons();
+    draw_hud();
+
+    glutSwapBuffers();
+}
+
+void draw_floor() {
+    GLfloat floor_mat_ambient[] = { 0.9f, 0.9f, 0.9f, 1.0f };
+    GLfloat floor_mat_diffuse[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, g_texture_wood);
+
+    glMaterialfv(GL_FRONT, GL_AMBIENT, floor_mat_ambient);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, floor_mat_diffuse);
+
+    glBegin(GL_QUADS);
+    glNormal3f(0.0f, 1.0f, 0.0f);
+    glTexCoord2f(0.0f, 0.0f);   glVertex3f(-100.0f, -1.8f, -100.0f);
+    glTexCoord2f(20.0f, 0.0f);  glVertex3f(100.0f, -1.8f, -100.0f);
+    glTexCoord2f(20.0f, 20.0f); glVertex3f(100.0f, -1.8f, 100.0f);
+    glTexCoord2f(0.0f, 20.0f);  glVertex3f(-100.0f, -1.8f, 100.0f);
+    glEnd();
+
+    glDisable(GL_TEXTURE_2D);
+}
+
+// use_model_materials が 0 なら呼び出し側で設定した材質で全体を1回で描く (ピアノ本体・鍵盤は 4.4.2 の材質で上書きする)。
+// 1 なら .mtl で定義されたサブメッシュごとに材質を切り替え、usemtl の無い範囲には呼び出し側の材質を使う
+void draw_model(const model_3d_t* model, int use_model_materials) {
+    if (model->index_count == 0) return;
+
+    if (model->vertex_array_id != 0) {
+        glBindVertexArray(model->vertex_array_id);
+    }
+    else {
+        glBindBuffer(GL_ARRAY_BUFFER, model->vertex_buffer_id);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->index_buffer_id);
+        set_model_vertex_arrays(1);
+    }
+
+    int has_model_materials = 0;
+    for (int i = 0; use_model_materials && i < model->submesh_count; ++i) {
+        if (model->submeshes[i].material.name[0] != '\0') has_model_materials = 1;
+    }
+    if (has_model_materials) {
+        model_material_t caller_material;
+        glGetMaterialfv(GL_FRONT, GL_AMBIENT, caller_material.ambient);
+        glGetMaterialfv(GL_FRONT, GL_DIFFUSE, caller_material.diffuse);
+        glGetMaterialfv(GL_FRONT, GL_SPECULAR, caller_material.specular);
+        glGetMaterialfv(GL_FRONT, GL_SHININESS, &caller_material.shininess);
+
+        for (int i = 0; i < model->submesh_count; ++i) {
+            const model_submesh_t* submesh = &model->submeshes[i];
+            apply_model_material(submesh->material.name[0] != '\0' ? &submesh->material : &caller_material);
+            glDrawElements(GL_TRIANGLES, submesh->index_count, GL_UNSIGNED_INT, (const void*)(sizeof(GLuint) * submesh->first_index));
+        }
+        apply_model_material(&caller_material);
+    }
+    else {
+        glDrawElements(GL_TRIANGLES, model->index_count, GL_UNSIGNED_INT, (const void*)0);
+    }
+
+    if (model->vertex_array_id != 0) {
+        glBindVertexArray(0);
+    }
+    else {
+        set_model_vertex_arrays(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+}
+
+void apply_model_material(const model_material_t* material) {
+    glMaterialfv(GL_FRONT, GL_AMBIENT, material->ambient);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, material->diffuse);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, material->specular);
+    glMaterialf(GL_FRONT, GL_SHININESS, material->shininess);
+}
+
+// 現在バインドされているVBOを mesh_vertex_t のレイアウトで頂点配列に割り当てる
+void set_model_vertex_arrays(int enable) {
+    if (!enable) {
+        glDisableClientState(GL_VERTEX_ARRAY);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        return;
+    }
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(mesh_vertex_t), (const void*)offsetof(mesh_vertex_t, position));
+    glNormalPointer(GL_FLOAT, sizeof(mesh_vertex_t), (const void*)offsetof(mesh_vertex_t, normal));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(mesh_vertex_t), (const void*)offsetof(mesh_vertex_t, tex_coord));
+}
+
+void draw_piano_body() {
+    glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_BLACK_PLASTIC_AMBIENT);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_BLACK_PLASTIC_DIFFUSE);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_BLACK_PLASTIC_SPECULAR);
+    glMaterialf(GL_FRONT, GL_SHININESS, MAT_BLACK_PLASTIC_SHININESS);
+
+    glPushMatrix();
+    glTranslatef(-3.5f, -0.8f, 1.5f);
+    draw_model(&g_model_piano_body, 0);
+    glPopMatrix();
+}
+
+void draw_piano_keys() {
+    if (g_key_shader_program == 0) {
+        draw_piano_keys_per_key();
+        return;
+    }
+
+    if (g_are_key_instances_dirty) {
+        update_key_instance_buffer();
+    }
+
+    glUseProgram(g_key_shader_program);
+    glUniform3fv(g_key_hover_emission_location, 1, MAT_HOVER_EMISSION);
+
+    glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_IVORY_AMBIENT);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_IVORY_DIFFUSE);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_IVORY_SPECULAR);
+    glMaterialf(GL_FRONT, GL_SHININESS, MAT_IVORY_SHININESS);
+    draw_key_instances(&g_model_white_key, 0, g_visible_white_key_count);
+
+    glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_BLACK_MATTE_AMBIENT);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_BLACK_MATTE_DIFFUSE);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_BLACK_MATTE_SPECULAR);
+    glMaterialf(GL_FRONT, GL_SHININESS, MAT_BLACK_MATTE_SHININESS);
+    draw_key_instances(&g_model_black_key, g_visible_white_key_count, g_visible_black_key_count);
+
+    glUseProgram(0);
+}
+
+// インスタンス描画に対応していない環境向け
+void draw_piano_keys_per_key() {
+    for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
+        piano_key_t* key = &g_piano_keys[i];
+        int object_index = get_scene_object_index(SCENE_OBJECT_KEY, i);
+        if (!g_is_scene_object_visible[object_index]) continue;
+
+        set_hover_emission(object_index);
+        glPushMatrix();
+
+        glTranslatef(key->center_pos[0], key->center_pos[1], key->center_pos[2]);
+        glTranslatef(0.0f, get_key_render_y(key), 0.0f);
+
+        if (key->type == KEY_TYPE_WHITE) {
+            glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_IVORY_AMBIENT);
+            glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_IVORY_DIFFUSE);
+            glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_IVORY_SPECULAR);
+            glMaterialf(GL_FRONT, GL_SHININESS, MAT_IVORY_SHININESS);
+            draw_model(&g_model_white_key, 0);
+        }
+        else {
+            glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_BLACK_MATTE_AMBIENT);
+            glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_BLACK_MATTE_DIFFUSE);
+            glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_BLACK_MATTE_SPECULAR);
+            glMaterialf(GL_FRONT, GL_SHININESS, MAT_BLACK_MATTE_SHININESS);
+            draw_model(&g_model_black_key, 0);
+        }
+
+        glPopMatrix();
+    }
+    set_hover_emission(-1);
+}
+
+// インスタンスバッファの first_instance 番目から instance_count 個の鍵盤を1回の描画命令で描く
+// 鍵盤はピアノの材質 (4.4.2) で上書きするため、サブメッシュに分けず全体を1回で描く
+void draw_key_instances(const model_3d_t* model, int first_instance, int instance_count) {
+    if (model->index_count == 0 || instance_count <= 0) return;
+
+    if (model->vertex_array_id != 0) {
+        glBindVertexArray(model->vertex_array_id);
+    }
+    else {
+        glBindBuffer(GL_ARRAY_BUFFER, model->vertex_buffer_id);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->index_buffer_id);
+        set_model_vertex_arrays(1);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_key_instance_buffer_id);
+    glEnableVertexAttribArray(KEY_INSTANCE_ATTRIB_LOCATION);
+    glVertexAttribPointer(KEY_INSTANCE_ATTRIB_LOCATION, 4, GL_FLOAT, GL_FALSE, 0, (const void*)(sizeof(float[4]) * first_instance));
+    glVertexAttribDivisor(KEY_INSTANCE_ATTRIB_LOCATION, 1);
+
+    glDrawElementsInstanced(GL_TRIANGLES, model->index_count, GL_UNSIGNED_INT, (const void*)0, instance_count);
+
+    glVertexAttribDivisor(KEY_INSTANCE_ATTRIB_LOCATION, 0);
+    glDisableVertexAttribArray(KEY_INSTANCE_ATTRIB_LOCATION);
+
+    if (model->vertex_array_id != 0) {
+        glBindVertexArray(0);
+    }
+    else {
+        set_model_vertex_arrays(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// 視錐台内の鍵盤だけを白鍵、黒鍵の順に詰めて格納する
+void update_key_instance_buffer() {
+    float instance_offsets[PIANO_KEY_COUNT][4];
+    int instance_count = 0;
+
+    g_visible_white_key_count = 0;
+    g_visible_black_key_count = 0;
+    for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
+        int key_index = g_key_instance_order[i];
+        int object_index = get_scene_object_index(SCENE_OBJECT_KEY, key_index);
+        if (!g_is_scene_object_visible[object_index]) continue;
+
+        piano_key_t* key = &g_piano_keys[key_index];
+        instance_offsets[instance_count][0] = key->center_pos[0];
+        instance_offsets[instance_count][1] = key->center_pos[1] + get_key_render_y(key);
+        instance_offsets[instance_count][2] = key->center_pos[2];
+        instance_offsets[instance_count][3] = (object_index == g_hovered_scene_object) ? 1.0f : 0.0f;
+        instance_count++;
+
+        if (key->type == KEY_TYPE_WHITE) g_visible_white_key_count++;
+        else g_visible_black_key_count++;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_key_instance_buffer_id);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float[4]) * instance_count, instance_offsets);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    g_are_key_instances_dirty = 0;
+}
+
+// ホバー中のオブジェクトだけ発光色を加えて強調する
+void set_hover_emission(int scene_object_index) {
+    int is_hovered = (scene_object_index >= 0 && scene_object_index == g_hovered_scene_object);
+    glMaterialfv(GL_FRONT, GL_EMISSION, is_hovered ? MAT_HOVER_EMISSION : MAT_NO_EMISSION);
+}
+
+void draw_buttons() {
+    glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_GREY_PLASTIC_AMBIENT);
+    glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_GREY_PLASTIC_DIFFUSE);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_GREY_PLASTIC_SPECULAR);
+    glMaterialf(GL_FRONT, GL_SHININESS, MAT_GREY_PLASTIC_SHININESS);
+
+    for (int i = 0; i < TIMBRE_BUTTON_COUNT; ++i) {
+        int object_index = get_scene_object_index(SCENE_OBJECT_TIMBRE_BUTTON, i);
+        if (!g_is_scene_object_visible[object_index]) continue;
+
+        set_hover_emission(object_index);
+        glPushMatrix();
+        glTranslatef(TIMBRE_BUTTON_X_POSITIONS[i], BUTTON_Y, BUTTON_Z);
+        draw_model(&g_model_timbre_button, 1);
+        glPopMatrix();
+    }
+
+    for (int i = 0; i < OCTAVE_BUTTON_COUNT; ++i) {
+        int object_index = get_scene_object_index(SCENE_OBJECT_OCTAVE_BUTTON, i);
+        if (!g_is_scene_object_visible[object_index]) continue;
+
+        set_hover_emission(object_index);
+        glPushMatrix();
+        glTranslatef(OCTAVE_BUTTON_POSITIONS[i][0], OCTAVE_BUTTON_POSITIONS[i][1], OCTAVE_BUTTON_POSITIONS[i][2]);
+        glRotatef(OCTAVE_BUTTON_POSITIONS[i][3], 0.0f, 1.0f, 0.0f);
+        draw_model(&g_model_octave_button, 1);
+        glPopMatrix();
+    }
+    set_hover_emission(-1);
+}
+
+// HUDの文字とレティクルを1回の描画呼び出しで描く。投影行列は display() が毎フレーム設定し直すため退避しない
+void draw_hud() {
+    hud_state_t state;
+    memset(&state, 0, sizeof(state));
+    state.audio_stats = g_hud_audio_stats;
+    state.window_width = g_window_width;
+    state.window_height = g_window_height;
+    state.octave_shift = g_current_octave_shift;
+    state.timbre_index = g_current_timbre_index;
+    state.is_sequencer_playing = g_is_sequencer_playing;
+    state.is_loading_assets = g_is_loading_assets;
+    state.loaded_asset_count = g_loaded_asset_count;
+    state.asset_count = g_asset_job_count;
+    if (!g_is_hud_state_valid || memcmp(&state, &g_hud_state, sizeof(state)) != 0) {
+        update_hud_vertex_buffer(&state);
+        g_hud_state = state;
+        g_is_hud_state_valid = 1;
+    }
+    if (g_hud_font_texture == 0 || g_hud_vertex_count == 0) return;
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0, g_window_width, 0, g_window_height);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glBindTexture(GL_TEXTURE_2D, g_hud_font_texture);
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_hud_vertex_buffer_id);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(hud_vertex_t), (const void*)offsetof(hud_vertex_t, position));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(hud_vertex_t), (const void*)offsetof(hud_vertex_t, tex_coord));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(hud_vertex_t), (const void*)offsetof(hud_vertex_t, color));
+
+    glDrawArrays(GL_TRIANGLES, 0, g_hud_vertex_count);
+
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_BLEND);
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_LIGHTING);
+}
+
+// 表示する文字列を組み立て、文字ごとの四角形とレティクルを頂点バッファへ書き込む
+void update_hud_vertex_buffer(const hud_state_t* state) {
+    static hud_vertex_t vertices[HUD_MAX_VERTICES];
+    static const GLubyte white[4] = { 255, 255, 255, 255 };
+    static const GLubyte green[4] = { 0, 255, 0, 255 };
+    static const GLubyte gray[4] = { 96, 96, 96, 255 };
+    int vertex_count = 0;
+    char text_buffer[256];
+
+    if (state->is_loading_assets) {
+        sprintf_s(text_buffer, sizeof(text_buffer), "Loading: %d / %d", state->loaded_asset_count, state->asset_count);
+        append_hud_text(vertices, &vertex_count, 0, text_buffer, white);
+
+        // 進捗バー (塗りつぶしセルを使った背景と進捗部分の2つの四角形)
+        float solid_u = 1.0f - 0.5f / HUD_ATLAS_COLUMNS;
+        float solid_v = 1.0f - 0.5f / HUD_ATLAS_ROWS;
+        float bar_x = (float)HUD_MARGIN_X;
+        float bar_y = (float)(state->window_height - HUD_MARGIN_Y - HUD_LINE_HEIGHT);
+        float progress = state->asset_count > 0 ? (float)state->loaded_asset_count / state->asset_count : 0.0f;
+        append_hud_quad(vertices, &vertex_count, bar_x, bar_y, bar_x + LOADING_BAR_WIDTH, bar_y + LOADING_BAR_HEIGHT,
+            solid_u, solid_v, solid_u, solid_v, gray);
+        append_hud_quad(vertices, &vertex_count, bar_x, bar_y, bar_x + LOADING_BAR_WIDTH * progress, bar_y + LOADING_BAR_HEIGHT,
+            solid_u, solid_v, solid_u, solid_v, green);
+    }
+    else {
+        vertex_count = append_hud_status_lines(vertices, state);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, g_hud_vertex_buffer_id);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(hud_vertex_t) * vertex_count, vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    g_hud_vertex_count = vertex_count;
+}
+
+// 通常時のHUD (演奏状態・音声統計・レティクル) の頂点を書き込み、頂点数を返す
+int append_hud_status_lines(hud_vertex_t* vertices, const hud_state_t* state) {
+    static const GLubyte white[4] = { 255, 255, 255, 255 };
+    static const GLubyte green[4] = { 0, 255, 0, 255 };
+    static const GLubyte red[4] = { 255, 102, 102, 255 };
+    const hud_audio_stats_t* stats = &state->audio_stats;
+    int vertex_count = 0;
+    char text_buffer[256];
+
+    sprintf_s(text_buffer, sizeof(text_buffer), "Octave: %+d", state->octave_shift);
+    append_hud_text(vertices, &vertex_count, 0, text_buffer, white);
+
+    sprintf_s(text_buffer, sizeof(text_buffer), "Timbre: %s", g_timbres[state->timbre_index].name);
+    append_hud_text(vertices, &vertex_count, 1, text_buffer, white);
+
+    if (state->is_sequencer_playing) {
+        append_hud_text(vertices, &vertex_count, 2, "Sequencer: Playing", green);
+    }
+    else {
+        append_hud_text(vertices, &vertex_count, 2, "Sequencer: Stopped", white);
+    }
+
+    // オーディオコールバックの処理時間統計
+    sprintf_s(text_buffer, sizeof(text_buffer), "Audio: %.3f / %.3f ms (%.1f%%)  Max: %.3f ms",
+        stats->last_duration_ns / 1.0e6, stats->last_budget_ns / 1.0e6,
+        stats->last_budget_ns > 0 ? 100.0 * stats->last_duration_ns / stats->last_budget_ns : 0.0,
+        stats->max_duration_ns / 1.0e6);
+    append_hud_text(vertices, &vertex_count, 3, text_buffer, stats->xrun_count > 0 ? red : white);
+
+    sprintf_s(text_buffer, sizeof(text_buffer), "Xruns: %llu  Callbacks: %llu",
+        (unsigned long long)stats->xrun_count, (unsigned long long)stats->callback_count);
+    append_hud_text(vertices, &vertex_count, 4, text_buffer, stats->xrun_count > 0 ? red : white);
+
+    // 使用率ヒストグラムは各区間に入ったコールバックの割合 (%) を並べる
+    int length = sprintf_s(text_buffer, sizeof(text_buffer), "Load:");
+    for (int bin = 0; bin < AUDIO_TIMING_HISTOGRAM_BINS && length > 0 && length < (int)sizeof(text_buffer); ++bin) {
+        length += sprintf_s(text_buffer + length, sizeof(text_buffer) - length, " %.0f",
+            stats->callback_count > 0 ? 100.0 * stats->histogram[bin] / stats->callback_count : 0.0);
+    }
+    append_hud_text(vertices, &vertex_count, 5, text_buffer, stats->xrun_count > 0 ? red : white);
+
+    // 先行合成中はリングバッファの残量 (現在値・最小値) と、足りずに無音を出した回数
+    if (g_render_ahead_frames > 0) {
+        sprintf_s(text_buffer, sizeof(text_buffer), "Ahead: %.1f / %.1f ms  Min: %.1f ms  Underruns: %llu  Synth: %.1f%%",
+            stats->last_fill_frames * 1.0e3 / g_audio_config.sample_rate, g_render_ahead_frames * 1.0e3 / g_audio_config.sample_rate,
+            stats->min_fill_frames * 1.0e3 / g_audio_config.sample_rate, (unsigned long long)stats->underrun_count,
+            stats->chunk_load_permille / 10.0);
+        append_hud_text(vertices, &vertex_count, 6, text_buffer, stats->underrun_count > 0 || stats->chunk_overrun_count > 0 ? red : white);
+    }
+
+    // 入力→発音の遅延 = 測定した入力→合成の遅延 + 出力側の推定値 (先行合成 + デバイスバッファのサイズから求めたもの。実測ではない)
+    if (g_output_latency_ms > 0.0) {
+        sprintf_s(text_buffer, sizeof(text_buffer), "Latency: %.1f ms (input %.2f / max %.2f + output est. %.1f)",
+            stats->mean_input_latency_ns / 1.0e6 + g_output_latency_ms,
+            stats->mean_input_latency_ns / 1.0e6, stats->max_input_latency_ns / 1.0e6, g_output_latency_ms);
+        append_hud_text(vertices, &vertex_count, g_render_ahead_frames > 0 ? 7 : 6, text_buffer, white);
+    }
+
+    // レティクル (塗りつぶしセルの中央をサンプルした細い四角形)
+    float solid_u = 1.0f - 0.5f / HUD_ATLAS_COLUMNS;
+    float solid_v = 1.0f - 0.5f / HUD_ATLAS_ROWS;
+    float center_x = (float)(state->window_width / 2);
+    float center_y = (float)(state->window_height / 2);
+    append_hud_quad(vertices, &vertex_count, center_x - RETICLE_SIZE, center_y, center_x + RETICLE_SIZE, center_y + 1.0f,
+        solid_u, solid_v, solid_u, solid_v, green);
+    append_hud_quad(vertices, &vertex_count, center_x, center_y - RETICLE_SIZE, center_x + 1.0f, center_y + RETICLE_SIZE,
+        solid_u, solid_v, solid_u, solid_v, green);
+    return vertex_count;
+}
+
+void append_hud_text(hud_vertex_t* vertices, int* vertex_count, int line_index, const char* text, const GLubyte color[4]) {
+    if (line_index >= HUD_MAX_LINES) return;
+
+    const float cell_u = 1.0f / HUD_ATLAS_COLUMNS;
+    const float cell_v = 1.0f / HUD_ATLAS_ROWS;
+    float pen_x = (float)HUD_MARGIN_X;
+    float pen_y = (float)(g_window_height - HUD_MARGIN_Y - (HUD_LINE_HEIGHT * line_index));
+
+    for (int i = 0; text[i] != '\0' && i < HUD_LINE_MAX_CHARS; ++i) {
+        int c = (unsigned char)text[i];
+        if (c < HUD_GLYPH_FIRST || c > HUD_GLYPH_LAST) c = '?';
+        int cell = c - HUD_GLYPH_FIRST;
+
+        // 空白は送り幅だけ進める
+        if (c != ' ') {
+            float u0 = (cell % HUD_ATLAS_COLUMNS) * cell_u;
+            float v0 = (cell / HUD_ATLAS_COLUMNS) * cell_v;
+            float x0 = pen_x - 1.0f;
+            float y0 = pen_y - HUD_GLYPH_BASELINE;
+            append_hud_quad(vertices, vertex_count, x0, y0, x0 + HUD_GLYPH_CELL_SIZE, y0 + HUD_GLYPH_CELL_SIZE,
+                u0, v0, u0 + cell_u, v0 + cell_v, color);
+        }
+        pen_x += g_hud_glyph_advances[cell];
+    }
+}
+
+void append_hud_quad(hud_vertex_t* vertices, int* vertex_count, float x0, float y0, float x1, float y1,
+    float u0, float v0, float u1, float v1, const GLubyte color[4]) {
+    if (*vertex_count + 6 > HUD_MAX_VERTICES) return;
+
+    const float corners[6][4] = {
+        { x0, y0, u0, v0 }, { x1, y0, u1, v0 }, { x1, y1, u1, v1 },
+        { x0, y0, u0, v0 }, { x1, y1, u1, v1 }, { x0, y1, u0, v1 },
+    };
+    for (int i = 0; i < 6; ++i) {
+        hud_vertex_t* vertex = &vertices[(*vertex_count)++];
+        vertex->position[0] = corners[i][0];
+        vertex->position[1] = corners[i][1];
+        vertex->tex_coord[0] = corners[i][2];
+        vertex->tex_coord[1] = corners[i][3];
+        memcpy(vertex->color, color, sizeof(vertex->color));
+    }
+}
+
+// オーディオスレッドの統計を読み取ってHUD用に保持する。毎フレーム読むと値が変わり続け、頂点を作り直すことになる
+void capture_hud_audio_stats() {
+    hud_audio_stats_t* stats = &g_hud_audio_stats;
+    stats->callback_count = ma_atomic_load_explicit_64(&g_audio_timing_stats.callback_count, ma_atomic_memory_order_relaxed);
+    stats->xrun_count = ma_atomic_load_explicit_64(&g_audio_timing_stats.xrun_count, ma_atomic_memory_order_relaxed);
+    stats->last_duration_ns = ma_atomic_load_explicit_32(&g_audio_timing_stats.last_duration_ns, ma_atomic_memory_order_relaxed);
+    stats->last_budget_ns = ma_atomic_load_explicit_32(&g_audio_timing_stats.last_budget_ns, ma_atomic_memory_order_relaxed);
+    stats->max_duration_ns = ma_atomic_load_explicit_32(&g_audio_timing_stats.max_duration_ns, ma_atomic_memory_order_relaxed);
+    for (int bin = 0; bin < AUDIO_TIMING_HISTOGRAM_BINS; ++bin) {
+        stats->histogram[bin] = ma_atomic_load_explicit_32(&g_audio_timing_stats.histogram[bin], ma_atomic_memory_order_relaxed);
+    }
+    stats->underrun_count = ma_atomic_load_explicit_64(&g_audio_timing_stats.underrun_count, ma_atomic_memory_order_relaxed);
+    stats->last_fill_frames = ma_atomic_load_explicit_32(&g_audio_timing_stats.last_fill_frames, ma_atomic_memory_order_relaxed);
+    stats->min_fill_frames = ma_atomic_load_explicit_32(&g_audio_timing_stats.min_fill_frames, ma_atomic_memory_order_relaxed);
+    ma_uint64 total_chunk_budget_ns = ma_atomic_load_explicit_64(&g_audio_timing_stats.total_chunk_budget_ns, ma_atomic_memory_order_relaxed);
+    stats->chunk_load_permille = total_chunk_budget_ns > 0
+        ? (ma_uint32)(1000 * ma_atomic_load_explicit_64(&g_audio_timing_stats.total_chunk_duration_ns, ma_atomic_memory_order_relaxed) / total_chunk_budget_ns) : 0;
+    stats->chunk_overrun_count = ma_atomic_load_explicit_64(&g_audio_timing_stats.chunk_overrun_count, ma_atomic_memory_order_relaxed);
+    ma_uint64 latency_count = ma_atomic_load_explicit_64(&g_audio_timing_stats.input_latency_count, ma_atomic_memory_order_relaxed);
+    stats->mean_input_latency_ns = latency_count > 0
+        ? (ma_uint32)(ma_atomic_load_explicit_64(&g_audio_timing_stats.total_input_latency_ns, ma_atomic_memory_order_relaxed) / latency_count) : 0;
+    stats->max_input_latency_ns = ma_atomic_load_explicit_32(&g_audio_timing_stats.max_input_latency_ns, ma_atomic_memory_order_relaxed);
+}
+
+// ============================================================================
+// 入力・イベント処理
+// ============================================================================
+
+void on_mouse_button(int button, int state, int x, int y) {
+    if (button != GLUT_LEFT_BUTTON || g_is_loading_assets) return;
+
+    if (state == GLUT_DOWN) {
+        // 画面中央のレティクルはカメラの正面方向なので、視線レイで最も手前のオブジェクトを選ぶ
+        vector_3d_t origin = { g_camera_pos[0], g_camera_pos[1], g_camera_pos[2] };
+        vector_3d_t direction = { g_camera_front[0], g_camera_front[1], g_camera_front[2] };
+        pick_result_t pick = pick_object_along_ray(origin, direction);
+        if (pick.object_index < 0) return;
+
+        scene_object_t* object = &g_scene_objects[pick.object_index];
+        switch (object->type) {
+        case SCENE_OBJECT_KEY:
+            g_mouse_held_note = g_piano_keys[object->index].midi_note;
+            trigger_note_on(g_mouse_held_note);
+            break;
+        case SCENE_OBJECT_TIMBRE_BUTTON:
+            printf("情報: 音色を「%s」に変更しました。\n", g_timbres[object->index].name);
+            g_current_timbre_index = object->index;
+            post_audio_event(AUDIO_EVENT_SET_TIMBRE, object->index);
+            break;
+        case SCENE_OBJECT_OCTAVE_BUTTON:
+            if (object->index == 0) { // Octave Down
+                if (g_current_octave_shift > OCTAVE_SHIFT_MIN) {
+                    g_current_octave_shift--;
+                    post_audio_event(AUDIO_EVENT_SET_OCTAVE, g_current_octave_shift);
+                    printf("情報: オクターブを下げました (%+d)。\n", g_current_octave_shift);
+                }
+            }
+            else { // Octave Up
+                if (g_current_octave_shift < OCTAVE_SHIFT_MAX) {
+                    g_current_octave_shift++;
+                    post_audio_event(AUDIO_EVENT_SET_OCTAVE, g_current_octave_shift);
+                    printf("情報: オクターブを上げました (%+d)。\n", g_current_octave_shift);
+                }
+            }
+            break;
+        default:
+            return;
+        }
+        request_redisplay();
+    }
+    else if (state == GLUT_UP && g_mouse_held_note > 0) {
+        trigger_note_off(g_mouse_held_note);
+        g_mouse_held_note = 0;
+        request_redisplay();
+    }
+}
+
+void on_keyboard_press(unsigned char key, int x, int y) {
+    float front_h_x = g_camera_front[0];
+    float front_h_z = g_camera_front[2];
+    float len = sqrt(front_h_x * front_h_x + front_h_z * front_h_z);
+    if (len > 0) {
+        front_h_x /= len;
+        front_h_z /= len;
+    }
+    float right_h_x = -front_h_z;
+    float right_h_z = front_h_x;
+
+    switch (key) {
+    case 'w': g_camera_pos[0] += front_h_x * CAMERA_MOVE_SPEED; g_camera_pos[2] += front_h_z * CAMERA_MOVE_SPEED; break;
+    case 's': g_camera_pos[0] -= front_h_x * CAMERA_MOVE_SPEED; g_camera_pos[2] -= front_h_z * CAMERA_MOVE_SPEED; break;
+    case 'a': g_camera_pos[0] -= right_h_x * CAMERA_MOVE_SPEED; g_camera_pos[2] -= right_h_z * CAMERA_MOVE_SPEED; break;
+    case 'd': g_camera_pos[0] += right_h_x * CAMERA_MOVE_SPEED; g_camera_pos[2] += right_h_z * CAMERA_MOVE_SPEED; break;
+    case 'q': g_camera_pos[1] += CAMERA_MOVE_SPEED; break;
+    case 'e': g_camera_pos[1] -= CAMERA_MOVE_SPEED; break;
+    case 27:  exit(0); break;
+    }
+    update_hovered_object();
+    request_redisplay();
+}
+
+void on_mouse_move(int x, int y) {
+    int center_x = g_window_width / 2;
+    int center_y = g_window_height / 2;
+
+    if (x == center_x && y == center_y) return;
+
+    float offset_x = (float)(x - center_x) * MOUSE_SENSITIVITY;
+    float offset_y = (float)(center_y - y) * MOUSE_SENSITIVITY;
+
+    g_camera_yaw += offset_x;
+    g_camera_pitch += offset_y;
+
+    if (g_camera_pitch > CAMERA_PITCH_MAX) g_camera_pitch = CAMERA_PITCH_MAX;
+    if (g_camera_pitch < CAMERA_PITCH_MIN) g_camera_pitch = CAMERA_PITCH_MIN;
+
+    float rad_yaw = g_camera_yaw * M_PI / 180.0f;
+    float rad_pitch = g_camera_pitch * M_PI / 180.0f;
+    g_camera_front[0] = cos(rad_yaw) * cos(rad_pitch);
+    g_camera_front[1] = sin(rad_pitch);
+    g_camera_front[2] = sin(rad_yaw) * cos(rad_pitch);
+
+    float len = sqrt(pow(g_camera_front[0], 2) + pow(g_camera_front[1], 2) + pow(g_camera_front[2], 2));
+    g_camera_front[0] /= len;
+    g_camera_front[1] /= len;
+    g_camera_front[2] /= len;
+
+    update_hovered_object();
+    glutWarpPointer(center_x, center_y);
+    request_redisplay();
+}
+
+void on_menu_select(int menu_id) {
+    switch (menu_id) {
+    case MENU_ID_SEQ_PLAY:
+        if (!g_is_sequencer_playing && !g_is_loading_assets && g_sequence_length > 0) {
+            g_is_sequencer_playing = 1;
+            post_audio_event(AUDIO_EVENT_SEQ_START, 0);
+            start_animation_timer();
+            request_redisplay();
+            printf("情報: シーケンスの再生を開始しました。\n");
+        }
+        break;
+    case MENU_ID_SEQ_STOP:
+        if (g_is_sequencer_playing) {
+            // 再生状態はオーディオスレッドからの停止通知を受けて解除する
+            post_audio_event(AUDIO_EVENT_SEQ_STOP, 0);
+            trigger_all_notes_off();
+            printf("情報: シーケンスを停止しました。\n");
+        }
+        break;
+    case MENU_ID_ALL_NOTES_OFF:
+        trigger_all_notes_off();
+        printf("情報: すべての音を止めました。\n");
+        break;
+    }
+}
+
+void on_reshape(int width, int height) {
+    g_window_width = (width > 0) ? width : 1;
+    g_window_height = (height > 0) ? height : 1;
+    glViewport(0, 0, g_window_width, g_window_height);
+    request_redisplay();
+}
+
+
+// ============================================================================
+// 描画フレーム制御
+// ============================================================================
+
+// 再描画要求を次のフレーム時刻まで溜め、まとめて1回だけ描画する
+void request_redisplay() {
+    if (g_is_frame_scheduled) return;
+    g_is_frame_scheduled = 1;
+
+    double elapsed_ms = (ma_timer_get_time_in_seconds(&g_monotonic_timer) - g_last_frame_time_s) * 1000.0;
+    unsigned int delay_ms = 0;
+    if (g_last_frame_time_s >= 0.0 && elapsed_ms < FRAME_MIN_INTERVAL_MS) {
+        delay_ms = (unsigned int)(FRAME_MIN_INTERVAL_MS - elapsed_ms);
+    }
+    glutTimerFunc(delay_ms, on_frame_timer, 0);
+}
+
+void on_frame_timer(int timer_value) {
+    g_is_frame_scheduled = 0;
+    glutPostRedisplay();
+}
+
+void enable_vsync() {
+#if defined(_WIN32)
+    if (WGLEW_EXT_swap_control) {
+        wglSwapIntervalEXT(1);
+        printf("情報: 垂直同期を有効にしました。\n");
+        return;
+    }
+#endif
+    printf("情報: 垂直同期を設定できないため、再描画間隔を %d ms 以上に制限します。\n", FRAME_MIN_INTERVAL_MS);
+}
+
+
+// ============================================================================
+// アニメーション・シーケンサー
+// ============================================================================
+
+// シミュレーションを実時間まで進め、描画を要求する。描画自体は display() が補間して行う
+void update_key_animation(int timer_value) {
+    process_ui_events();
+    advance_key_animation(ma_timer_get_time_in_seconds(&g_monotonic_timer));
+
+    int is_animating = (g_animating_key_count > 0);
+    if (is_animating) {
+        request_redisplay();
+    }
+
+    // シーケンサー再生中はオーディオスレッドからの通知を受け取るために動かし続ける
+    if (is_animating || g_is_sequencer_playing) {
+        glutTimerFunc(ANIMATION_TIMER_MS, update_key_animation, timer_value + 1);
+    }
+    else {
+        g_is_animation_timer_running = 0;
+        request_redisplay();
+    }
+}
+
+// 異常を示す値 (xrun・アンダーラン・超過の回数と、表示精度での最大値・最小残量) が変わったか。
+// コールバック回数や直近の処理時間はデバイスが動いている限り毎回変わるため、ここでは見ない
+int has_hud_audio_alert_changed(const hud_audio_stats_t* previous, const hud_audio_stats_t* current) {
+    const ma_uint32 sample_rate = g_audio_config.sample_rate > 0 ? g_audio_config.sample_rate : 1;
+    return previous->xrun_count != current->xrun_count
+        || previous->underrun_count != current->underrun_count
+        || previous->chunk_overrun_count != current->chunk_overrun_count
+        || previous->max_duration_ns / 1000 != current->max_duration_ns / 1000
+        || previous->max_input_latency_ns / 10000 != current->max_input_latency_ns / 10000
+        || (ma_uint64)previous->min_fill_frames * 10000 / sample_rate != (ma_uint64)current->min_fill_frames * 10000 / sample_rate;
+}
+
+// 鍵盤アニメーションのタイマーは止まることがあるため、HUDの音声統計はこの低頻度のタイマーで取り込む。
+// 再描画を求めるのは異常を示す値が変わった時だけで、それ以外の値は次に何かで再描画されたときに反映される。
+// こうしないと演奏していない間もコールバック回数の更新だけで再描画が続く
+void on_hud_refresh_timer(int timer_value) {
+    hud_audio_stats_t previous_stats = g_hud_audio_stats;
+    capture_hud_audio_stats();
+    if (has_hud_audio_alert_changed(&previous_stats, &g_hud_audio_stats)) {
+        request_redisplay();
+    }
+    glutTimerFunc(HUD_REFRESH_MS, on_hud_refresh_timer, timer_value + 1);
+}
+
+void start_animation_timer() {
+    if (g_is_animation_timer_running) return;
+    g_is_animation_timer_running = 1;
+    glutTimerFunc(ANIMATION_TIMER_MS, update_key_animation, 1);
+}
+
+void set_key_target_y(int key_index, float target_y_pos) {
+    piano_key_t* key = &g_piano_keys[key_index];
+    key->target_y_pos = target_y_pos;
+
+    if (!key->is_animating) {
+        // 停止中の経過時間を持ち越さないよう、最初の鍵盤が動き出す時点から時間を数える
+        if (g_animating_key_count == 0) {
+            g_animation_time_s = ma_timer_get_time_in_seconds(&g_monotonic_timer);
+            g_animation_accumulator_s = 0.0;
+        }
+        key->is_animating = 1;
+        key->previous_y_pos = key->current_y_pos;
+        g_animating_keys[g_animating_key_count++] = key_index;
+    }
+    start_animation_timer();
+}
+
+// 前回からの実経過時間を ANIMATION_STEP_S 刻みで消化する (タイマーの精度に依存しない)
+void advance_key_animation(double now_s) {
+    if (g_animating_key_count == 0) return;
+
+    double elapsed_s = now_s - g_animation_time_s;
+    g_animation_time_s = now_s;
+    if (elapsed_s < 0.0) elapsed_s = 0.0;
+    g_animation_accumulator_s += elapsed_s;
+    if (g_animation_accumulator_s > ANIMATION_MAX_CATCHUP_S) g_animation_accumulator_s = ANIMATION_MAX_CATCHUP_S;
+
+    while (g_animation_accumulator_s >= ANIMATION_STEP_S && g_animating_key_count > 0) {
+        step_key_animation();
+        g_animation_accumulator_s -= ANIMATION_STEP_S;
+    }
+    g_are_key_instances_dirty = 1;
+}
+
+// 動いている鍵盤だけを1ステップ進め、目標位置に着いた鍵盤は一覧から外す
+void step_key_animation() {
+    // 基準間隔あたり KEY_ANIMATION_SPEED だけ近づく指数的な追従を、固定ステップ幅に換算する
+    static double step_factor = -1.0;
+    if (step_factor < 0.0) {
+        step_factor = 1.0 - pow(1.0 - KEY_ANIMATION_SPEED, ANIMATION_STEP_S / KEY_ANIMATION_REFERENCE_S);
+    }
+
+    int write_index = 0;
+    for (int i = 0; i < g_animating_key_count; ++i) {
+        piano_key_t* key = &g_piano_keys[g_animating_keys[i]];
+        float diff = key->target_y_pos - key->current_y_pos;
+
+        key->previous_y_pos = key->current_y_pos;
+        if (fabs(diff) > 0.001f) {
+            key->current_y_pos += (float)(diff * step_factor);
+            g_animating_keys[write_index++] = g_animating_keys[i];
+        }
+        else {
+            key->current_y_pos = key->target_y_pos;
+            key->previous_y_pos = key->target_y_pos;
+            key->is_animating = 0;
+        }
+    }
+    g_animating_key_count = write_index;
+}
+
+// 直前の2ステップの間を、まだ消化していない経過時間の割合で補間した描画位置
+float get_key_render_y(const piano_key_t* key) {
+    if (!key->is_animating) return key->current_y_pos;
+
+    float alpha = (float)(g_animation_accumulator_s / ANIMATION_STEP_S);
+    return key->previous_y_pos + (key->current_y_pos - key->previous_y_pos) * alpha;
+}
+
+void process_ui_events() {
+    audio_event_t* event;
+    while ((event = peek_audio_event(&g_ui_event_queue)) != NULL) {
+        switch (event->type) {
+        case AUDIO_EVENT_NOTE_ON:
+        case AUDIO_EVENT_NOTE_OFF:
+            if (event->value > 0 && event->value < MIDI_NOTE_COUNT && g_note_keys[event->value] >= 0) {
+                set_key_target_y(g_note_keys[event->value], (event->type == AUDIO_EVENT_NOTE_ON) ? KEY_PRESSED_Y_OFFSET : 0.0f);
+            }
+            break;
+        case AUDIO_EVENT_SEQ_FINISHED:
+            g_is_sequencer_playing = 0;
+            if (event->value) {
+                printf("情報: シーケンスの再生が終了しました。\n");
+            }
+            if (g_sequencer.fired_event_count > 0) {
+                printf("情報: シーケンサーのタイミング誤差: 平均 %.2f us / 最大 %.2f us (イベント数: %d)\n",
+                    g_sequencer.total_error_frames / g_sequencer.fired_event_count * 1.0e6 / g_audio_config.sample_rate,
+                    g_sequencer.max_error_frames * 1.0e6 / g_audio_config.sample_rate,
+                    g_sequencer.fired_event_count);
+            }
+            request_redisplay();
+            break;
+        default: break;
+        }
+        pop_audio_event(&g_ui_event_queue);
+    }
+}
+
+// 以下のシーケンサー処理はオーディオスレッドから呼ばれる
+void start_sequencer(ma_uint64 start_time) {
+    g_sequencer.is_playing = 1;
+    g_sequencer.event_index = 0;
+    g_sequencer.sounding_note = 0;
+    g_sequencer.next_event_time = (double)start_time;
+    g_sequencer.fired_event_count = 0;
+    g_sequencer.total_error_frames = 0.0;
+    g_sequencer.max_error_frames = 0.0;
+}
+
+void stop_sequencer(int reached_end) {
+    if (!g_sequencer.is_playing) return;
+
+    if (g_sequencer.sounding_note > 0) {
+        release_note_voice(g_sequencer.sounding_note);
+        push_audio_event(&g_ui_event_queue, AUDIO_EVENT_NOTE_OFF, g_sequencer.sounding_note, 0);
+    }
+    g_sequencer.is_playing = 0;
+    g_sequencer.sounding_note = 0;
+    push_audio_event(&g_ui_event_queue, AUDIO_EVENT_SEQ_FINISHED, reached_end, 0);
+}
+
+void advance_sequencer(ma_uint64 now) {
+    // 発音時刻に達したイベントをすべて処理する (音価0のイベントが続く場合もある)
+    while (g_sequencer.is_playing && get_sequencer_next_frame() <= now) {
+        if (g_sequencer.event_index >= g_sequence_length) {
+            stop_sequencer(1);
+            return;
+        }
+
+        sequence_event_t* current_event = &g_sequence[g_sequencer.event_index];
+        int previous_note = g_sequencer.sounding_note;
+
+        if (previous_note > 0 && previous_note != current_event->midi_note) {
+            release_note_voice(previous_note);
+            push_audio_event(&g_ui_event_queue, AUDIO_EVENT_NOTE_OFF, previous_note, now);
+        }
+        if (current_event->midi_note > 0) {
+            start_note_voice(current_event->midi_note);
+            push_audio_event(&g_ui_event_queue, AUDIO_EVENT_NOTE_ON, current_event->midi_note, now);
+        }
+
+        double error_frames = fabs((double)now - g_sequencer.next_event_time);
+        g_sequencer.total_error_frames += error_frames;
+        if (error_frames > g_sequencer.max_error_frames) g_sequencer.max_error_frames = error_frames;
+        g_sequencer.fired_event_count++;
+
+        // 理想時刻を小数で積算し、丸め誤差が曲の長さに応じて蓄積しないようにする
+        g_sequencer.sounding_note = current_event->midi_note;
+        g_sequencer.next_event_time += current_event->duration_ms * g_audio_config.sample_rate / 1000.0;
+        g_sequencer.event_index++;
+    }
+}
+
+ma_uint64 get_sequencer_next_frame() {
+    return (ma_uint64)floor(g_sequencer.next_event_time + 0.5);
+}
+
+// ============================================================================
+// オーディオ処理
+// ============================================================================
+
+// 先行合成中はリングバッファから写すだけにし、合成の処理時間の揺れをデバイスのコールバックへ持ち込まない
+// 処理時間統計はどちらの場合もデバイスのコールバック1回を1件として記録する
+void audio_callback(ma_device* p_device, void* p_output, const void* p_input, ma_uint32 frame_count) {
+    (void)p_device;
+    (void)p_input;
+
+    double callback_start_s = ma_timer_get_time_in_seconds(&g_monotonic_timer);
+    if (ma_atomic_load_explicit_32(&g_is_render_ahead_running, ma_atomic_memory_order_acquire)) {
+        read_render_ahead_frames((float*)p_output, frame_count);
+    }
+    else {
+        synthesize_audio((float*)p_output, frame_count);
+    }
+    record_audio_callback_timing(callback_start_s, frame_count);
+}
+
+void synthesize_audio(float* output_buffer, ma_uint32 frame_count) {
+    // ワーカーと同じコアで合成しないよう、合成を受け持つスレッドを最初の呼び出しで固定する
+    if (g_render_worker_count > 0 && !g_is_synthesis_thread_pinned) {
+        pin_render_thread(0);
+        g_is_synthesis_thread_pinned = 1;
+    }
+    remove_finished_voices();
+
+    // 時刻が来たイベントを適用し、次のイベント時刻までを1区間として合成する。
+    // ブロック内の時刻を指定したイベント (シーケンサー) はそのフレームから鳴るが、UIからのイベントは送った時点の
+    // g_audio_frame_clock (= 次のブロックの先頭) で刻印されるため、ブロックの先頭でまとめて適用される (ブロック単位の精度)
+    ma_uint64 callback_start_time = g_audio_frame_clock;
+    ma_uint32 frame = 0;
+    while (frame < frame_count) {
+        ma_uint64 now = callback_start_time + frame;
+        ma_uint32 segment_end = frame_count;
+        audio_event_t* event;
+        while ((event = peek_audio_event(&g_audio_event_queue)) != NULL) {
+            if (event->frame_time > now) {
+                if (event->frame_time < callback_start_time + frame_count) {
+                    segment_end = (ma_uint32)(event->frame_time - callback_start_time);
+                }
+                break;
+            }
+            apply_audio_event(event);
+            pop_audio_event(&g_audio_event_queue);
+        }
 
-GLuint load_ppm_texture(const char* filename) {
-    GLuint texture_id;
-    int width, height, max_color;
-    char buffer[256];
-    FILE* file;
+        advance_sequencer(now);
+        if (g_sequencer.is_playing) {
+            ma_uint64 sequencer_time = get_sequencer_next_frame();
+            if (sequencer_time < callback_start_time + segment_end) {
+                segment_end = (ma_uint32)(sequencer_time - callback_start_time);
+            }
+        }
 
-    if (fopen_s(&file, filename, "rb") != 0 || file == NULL) {
-        fprintf(stderr, "エラー: テクスチャファイル '%s' を開けません。\n", filename);
-        return 0;
+        render_audio_frames(output_buffer + frame * 2, segment_end - frame);
+        frame = segment_end;
     }
 
-    fgets(buffer, sizeof(buffer), file);
-    if (strncmp(buffer, "P6", 2) != 0) {
-        fprintf(stderr, "エラー: '%s' はP6形式のPPMファイルではありません。\n", filename);
-        fclose(file);
-        return 0;
-    }
+    ma_atomic_store_explicit_64(&g_audio_frame_clock, callback_start_time + frame_count, ma_atomic_memory_order_release);
+    park_render_workers();
+}
 
-    do {
-        fgets(buffer, sizeof(buffer), file);
-    } while (strncmp(buffer, "#", 1) == 0);
+// 書き込むのはオーディオスレッドだけなので、読み込み→加算→格納でも値は失われない
+void record_audio_callback_timing(double start_s, ma_uint32 frame_count) {
+    audio_timing_stats_t* stats = &g_audio_timing_stats;
+    double duration_s = ma_timer_get_time_in_seconds(&g_monotonic_timer) - start_s;
+    ma_uint32 duration_ns = (ma_uint32)(duration_s * 1.0e9);
+    ma_uint32 budget_ns = (ma_uint32)((double)frame_count * 1.0e9 / g_audio_config.sample_rate);
 
-    sscanf_s(buffer, "%d %d", &width, &height);
+    int bin = (budget_ns > 0) ? (int)((ma_uint64)duration_ns * 10 / budget_ns) : AUDIO_TIMING_HISTOGRAM_BINS - 1;
+    if (bin >= AUDIO_TIMING_HISTOGRAM_BINS) bin = AUDIO_TIMING_HISTOGRAM_BINS - 1;
 
-    fgets(buffer, sizeof(buffer), file);
-    sscanf_s(buffer, "%d", &max_color);
-    if (max_color != 255) {
-        fprintf(stderr, "警告: '%s' の最大色深度が255ではありません。\n", filename);
+    ma_atomic_store_explicit_32(&stats->last_duration_ns, duration_ns, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_32(&stats->last_budget_ns, budget_ns, ma_atomic_memory_order_relaxed);
+    if (duration_ns > stats->max_duration_ns) {
+        ma_atomic_store_explicit_32(&stats->max_duration_ns, duration_ns, ma_atomic_memory_order_relaxed);
     }
-
-    unsigned char* pixel_data = (unsigned char*)malloc(width * height * 3);
-    if (pixel_data == NULL) {
-        fprintf(stderr, "エラー: テクスチャデータのメモリ確保に失敗しました。\n");
-        fclose(file);
-        return 0;
+    if (duration_ns > budget_ns) {
+        ma_atomic_store_explicit_64(&stats->xrun_count, stats->xrun_count + 1, ma_atomic_memory_order_relaxed);
     }
+    ma_atomic_store_explicit_32(&stats->histogram[bin], stats->histogram[bin] + 1, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_64(&stats->total_duration_ns, stats->total_duration_ns + duration_ns, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_64(&stats->total_budget_ns, stats->total_budget_ns + budget_ns, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_64(&stats->callback_count, stats->callback_count + 1, ma_atomic_memory_order_relaxed);
+}
 
-    fread(pixel_data, 1, width * height * 3, file);
-    fclose(file);
-
-    glGenTextures(1, &texture_id);
-    glBindTexture(GL_TEXTURE_2D, texture_id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixel_data);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+// 先行合成スレッドのチャンク単位の合成時間。書き込むのは合成スレッドだけ
+void record_render_ahead_chunk_timing(double start_s, ma_uint32 frame_count) {
+    audio_timing_stats_t* stats = &g_audio_timing_stats;
+    double duration_s = ma_timer_get_time_in_seconds(&g_monotonic_timer) - start_s;
+    ma_uint32 duration_ns = (ma_uint32)(duration_s * 1.0e9);
+    ma_uint32 budget_ns = (ma_uint32)((double)frame_count * 1.0e9 / g_audio_config.sample_rate);
 
-    free(pixel_data);
-    printf("情報: PPMテクスチャ '%s' を読み込みました (ID: %d, サイズ: %dx%d)。\n", filename, texture_id, width, height);
-    return texture_id;
+    if (duration_ns > stats->max_chunk_duration_ns) {
+        ma_atomic_store_explicit_32(&stats->max_chunk_duration_ns, duration_ns, ma_atomic_memory_order_relaxed);
+    }
+    if (duration_ns > budget_ns) {
+        ma_atomic_store_explicit_64(&stats->chunk_overrun_count, stats->chunk_overrun_count + 1, ma_atomic_memory_order_relaxed);
+    }
+    ma_atomic_store_explicit_64(&stats->total_chunk_duration_ns, stats->total_chunk_duration_ns + duration_ns, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_64(&stats->total_chunk_budget_ns, stats->total_chunk_budget_ns + budget_ns, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_64(&stats->chunk_count, stats->chunk_count + 1, ma_atomic_memory_order_relaxed);
 }
 
-void load_timbre_file(const char* filename, int timbre_index) {
-    if (timbre_index < 0 || timbre_index >= TIMBRE_BUTTON_COUNT) return;
-
-    FILE* file;
-    timbre_t* timbre = &g_timbres[timbre_index];
+// 書き込むのは合成スレッドだけなので、record_audio_callback_timing と同じく読み込み→加算→格納でよい
+void record_input_latency(double post_time_s) {
+    audio_timing_stats_t* stats = &g_audio_timing_stats;
+    double latency_s = ma_timer_get_time_in_seconds(&g_monotonic_timer) - post_time_s;
+    ma_uint32 latency_ns = latency_s > 0.0 ? (ma_uint32)(latency_s * 1.0e9) : 0;
 
-    if (fopen_s(&file, filename, "r") != 0 || file == NULL) {
-        fprintf(stderr, "警告: 音色ファイル '%s' を開けません。デフォルト音色を適用します。\n", filename);
-        timbre->harmonic_count = 1;
-        timbre->harmonics = (harmonic_t*)malloc(sizeof(harmonic_t));
-        timbre->harmonics[0] = (harmonic_t){ 1.0f, 0.0f };
-        sprintf_s(timbre->name, sizeof(timbre->name), "Default Sine");
-        return;
+    if (latency_ns > stats->max_input_latency_ns) {
+        ma_atomic_store_explicit_32(&stats->max_input_latency_ns, latency_ns, ma_atomic_memory_order_relaxed);
     }
+    ma_atomic_store_explicit_64(&stats->total_input_latency_ns, stats->total_input_latency_ns + latency_ns, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_64(&stats->input_latency_count, stats->input_latency_count + 1, ma_atomic_memory_order_relaxed);
+}
 
-    char name_buffer[64];
-    fgets(name_buffer, sizeof(name_buffer), file);
-    if (sscanf_s(name_buffer, "%63[^\n]", timbre->name, (unsigned)_countof(timbre->name)) != 1) {
-        sprintf_s(timbre->name, sizeof(timbre->name), "Unnamed %d", timbre_index);
-    }
+void write_audio_timing_report() {
+    audio_timing_stats_t* stats = &g_audio_timing_stats;
+    if (g_audio_stats_filename == NULL) return;
 
-    if (fscanf_s(file, "%d", &timbre->harmonic_count) != 1 || timbre->harmonic_count <= 0) {
-        fprintf(stderr, "エラー: '%s' の倍音数が不正です。\n", filename);
-        fclose(file);
+    FILE* file;
+    if (fopen_s(&file, g_audio_stats_filename, "w") != 0 || file == NULL) {
+        fprintf(stderr, "エラー: 音声統計ファイル '%s' を作成できません。\n", g_audio_stats_filename);
         return;
     }
 
-    timbre->harmonics = (harmonic_t*)malloc(sizeof(harmonic_t) * timbre->harmonic_count);
-    if (timbre->harmonics == NULL) {
-        fprintf(stderr, "エラー: 倍音データのメモリ確保に失敗しました。\n");
-        fclose(file);
-        return;
+    ma_uint64 callback_count = ma_atomic_load_explicit_64(&stats->callback_count, ma_atomic_memory_order_relaxed);
+    ma_uint64 total_duration_ns = ma_atomic_load_explicit_64(&stats->total_duration_ns, ma_atomic_memory_order_relaxed);
+    ma_uint64 total_budget_ns = ma_atomic_load_explicit_64(&stats->total_budget_ns, ma_atomic_memory_order_relaxed);
+
+    fprintf(file, "metric,value\n");
+    fprintf(file, "kernel,%s\n", g_render_voice_kernel_name);
+    fprintf(file, "render_threads,%d\n", g_render_worker_count + 1);
+    ma_uint64 input_latency_count = ma_atomic_load_explicit_64(&stats->input_latency_count, ma_atomic_memory_order_relaxed);
+    fprintf(file, "sample_rate,%u\n", g_audio_config.sample_rate);
+    fprintf(file, "estimated_output_latency_ms,%.3f\n", g_output_latency_ms);
+    fprintf(file, "mean_input_latency_ms,%.3f\n", input_latency_count > 0 ? ma_atomic_load_explicit_64(&stats->total_input_latency_ns, ma_atomic_memory_order_relaxed) / 1.0e6 / input_latency_count : 0.0);
+    fprintf(file, "max_input_latency_ms,%.3f\n", ma_atomic_load_explicit_32(&stats->max_input_latency_ns, ma_atomic_memory_order_relaxed) / 1.0e6);
+    if (g_render_ahead_frames > 0) {
+        fprintf(file, "render_ahead_ms,%.3f\n", g_render_ahead_frames * 1.0e3 / g_audio_config.sample_rate);
+        fprintf(file, "render_ahead_underruns,%llu\n", (unsigned long long)ma_atomic_load_explicit_64(&stats->underrun_count, ma_atomic_memory_order_relaxed));
+        fprintf(file, "render_ahead_min_fill_ms,%.3f\n", ma_atomic_load_explicit_32(&stats->min_fill_frames, ma_atomic_memory_order_relaxed) * 1.0e3 / g_audio_config.sample_rate);
+        ma_uint64 chunk_count = ma_atomic_load_explicit_64(&stats->chunk_count, ma_atomic_memory_order_relaxed);
+        ma_uint64 total_chunk_duration_ns = ma_atomic_load_explicit_64(&stats->total_chunk_duration_ns, ma_atomic_memory_order_relaxed);
+        ma_uint64 total_chunk_budget_ns = ma_atomic_load_explicit_64(&stats->total_chunk_budget_ns, ma_atomic_memory_order_relaxed);
+        fprintf(file, "render_ahead_chunks,%llu\n", (unsigned long long)chunk_count);
+        fprintf(file, "render_ahead_chunk_overruns,%llu\n", (unsigned long long)ma_atomic_load_explicit_64(&stats->chunk_overrun_count, ma_atomic_memory_order_relaxed));
+        fprintf(file, "render_ahead_mean_chunk_us,%.3f\n", chunk_count > 0 ? total_chunk_duration_ns / 1.0e3 / chunk_count : 0.0);
+        fprintf(file, "render_ahead_max_chunk_us,%.3f\n", ma_atomic_load_explicit_32(&stats->max_chunk_duration_ns, ma_atomic_memory_order_relaxed) / 1.0e3);
+        fprintf(file, "render_ahead_utilization_percent,%.3f\n", total_chunk_budget_ns > 0 ? 100.0 * total_chunk_duration_ns / total_chunk_budget_ns : 0.0);
     }
-    for (int i = 0; i < timbre->harmonic_count; ++i) {
-        if (fscanf_s(file, "%f,%f", &timbre->harmonics[i].amplitude, &timbre->harmonics[i].phase_shift) != 2) {
-            fprintf(stderr, "警告: '%s' の倍音%dの読み込みに失敗しました。\n", filename, i + 1);
-            timbre->harmonics[i] = (harmonic_t){ 0.0f, 0.0f };
+    fprintf(file, "callbacks,%llu\n", (unsigned long long)callback_count);
+    fprintf(file, "xruns,%llu\n", (unsigned long long)ma_atomic_load_explicit_64(&stats->xrun_count, ma_atomic_memory_order_relaxed));
+    fprintf(file, "mean_duration_us,%.3f\n", callback_count > 0 ? total_duration_ns / 1.0e3 / callback_count : 0.0);
+    fprintf(file, "max_duration_us,%.3f\n", ma_atomic_load_explicit_32(&stats->max_duration_ns, ma_atomic_memory_order_relaxed) / 1.0e3);
+    fprintf(file, "mean_budget_us,%.3f\n", callback_count > 0 ? total_budget_ns / 1.0e3 / callback_count : 0.0);
+    fprintf(file, "mean_utilization_percent,%.3f\n", total_budget_ns > 0 ? 100.0 * total_duration_ns / total_budget_ns : 0.0);
+    for (int bin = 0; bin < AUDIO_TIMING_HISTOGRAM_BINS; ++bin) {
+        ma_uint32 bin_count = ma_atomic_load_explicit_32(&stats->histogram[bin], ma_atomic_memory_order_relaxed);
+        if (bin < AUDIO_TIMING_HISTOGRAM_BINS - 1) {
+            fprintf(file, "histogram_%d_%d_percent,%u\n", bin * 10, (bin + 1) * 10, bin_count);
+        }
+        else {
+            fprintf(file, "histogram_over_100_percent,%u\n", bin_count);
         }
     }
 
     fclose(file);
-    printf("情報: 音色 '%s' (%s) を読み込みました (倍音数: %d)。\n", timbre->name, filename, timbre->harmonic_count);
+    printf("情報: 音声統計を '%s' に書き出しました。\n", g_audio_stats_filename);
 }
 
-void load_sequence_file(const char* filename, float tempo) {
-    FILE* file;
-    if (fopen_s(&file, filename, "r") != 0 || file == NULL) {
-        fprintf(stderr, "エラー: 楽譜ファイル '%s' を開けません。\n", filename);
-        return;
-    }
+void render_audio_frames(float* output_buffer, ma_uint32 frame_count) {
+    timbre_t* current_timbre = &g_timbres[g_audio_timbre_index];
 
-    char line[256];
-    g_sequence_length = 0;
-    while (fgets(line, sizeof(line), file)) {
-        if (strlen(line) > 2) g_sequence_length++;
-    }
-    if (g_sequence_length == 0) { fclose(file); return; }
+    for (ma_uint32 block_start = 0; block_start < frame_count; block_start += AUDIO_RENDER_BLOCK_FRAMES) {
+        int block_frames = (int)(frame_count - block_start);
+        if (block_frames > AUDIO_RENDER_BLOCK_FRAMES) block_frames = AUDIO_RENDER_BLOCK_FRAMES;
+        memset(g_mix_buffer, 0, sizeof(float) * block_frames);
 
-    g_sequence = (sequence_event_t*)malloc(sizeof(sequence_event_t) * g_sequence_length);
-    if (g_sequence == NULL) {
-        fprintf(stderr, "エラー: シーケンスデータのメモリ確保に失敗しました。\n");
-        fclose(file);
-        return;
-    }
+        // 発音数が多ければボイスをワーカーと分け合い、自分の担当分を合成してから各ワーカーの結果を足し込む
+        int partition_count = 1;
+        if (g_render_worker_count > 0 && g_active_voice_count >= RENDER_PARALLEL_MIN_VOICES) {
+            partition_count = g_render_worker_count + 1;
+            dispatch_render_workers(current_timbre, g_audio_octave_shift, block_frames);
+        }
+        for (int v = 0; v < g_active_voice_count; v += partition_count) {
+            render_voice_block(&g_voices[g_active_voices[v]], current_timbre, g_audio_octave_shift, g_mix_buffer, block_frames);
+        }
+        if (partition_count > 1) {
+            collect_render_workers(block_frames);
+        }
 
-    rewind(file);
-    int event_index = 0;
-    while (fgets(line, sizeof(line), file) && event_index < g_sequence_length) {
-        if (strlen(line) < 3) continue;
+        for (int i = 0; i < block_frames; ++i) {
+            float mixed_sample = g_mix_buffer[i];
+            if (mixed_sample > 1.0f) mixed_sample = 1.0f;
+            if (mixed_sample < -1.0f) mixed_sample = -1.0f;
 
-        char note_char = line[0];
-        char accidental_char = line[1];
-        int octave = line[2] - '0';
-        char dot_char = line[3];
-        char duration_char = line[4];
+            output_buffer[0] = mixed_sample;
+            output_buffer[1] = mixed_sample;
+            output_buffer += 2;
+        }
+    }
+}
 
-        int midi_note = 0;
-        if (note_char == 'M') {
-            midi_note = 0;
+void remove_finished_voices() {
+    int voice_count = 0;
+    for (int v = 0; v < g_active_voice_count; ++v) {
+        if (g_voices[g_active_voices[v]].envelope_state == ENV_STATE_OFF) {
+            g_free_voices[g_free_voice_count++] = g_active_voices[v];
         }
         else {
-            int base_note = 0;
-            switch (note_char) {
-            case 'C': base_note = 0; break; case 'D': base_note = 2; break;
-            case 'E': base_note = 4; break; case 'F': base_note = 5; break;
-            case 'G': base_note = 7; break; case 'A': base_note = 9; break;
-            case 'B': base_note = 11; break;
-            default: continue;
+            g_active_voices[voice_count++] = g_active_voices[v];
+        }
+    }
+    g_active_voice_count = voice_count;
+}
+
+void render_voice_block(voice_t* voice, const timbre_t* timbre, int octave_shift, float* mix_buffer, int block_frames) {
+    const double attack_increment = 1.0 / (g_audio_config.sample_rate * AUDIO_ATTACK_TIME_S);
+    const double release_decrement = voice->release_decrement;
+
+    // 周波数と位相増分はブロックにつき1回だけ求める
+    int shifted_note = voice->midi_note + (octave_shift * 12);
+    const float* table = get_wavetable_for_note(timbre, shifted_note);
+    double phase_increment = midi_to_freq(shifted_note) / g_audio_config.sample_rate;
+    if (phase_increment >= 0.5) {
+        // ナイキスト周波数以上の音は鳴らさず、エンベロープだけ進める
+        table = NULL;
+    }
+
+    // エンベロープを直線区間に分割し、状態遷移はちょうどそのフレームで行う
+    int rendered_frames = 0;
+    while (rendered_frames < block_frames && voice->envelope_state != ENV_STATE_OFF) {
+        int remaining_frames = block_frames - rendered_frames;
+        int segment_frames = remaining_frames;
+        double gain = voice->current_amplitude;
+        double gain_step = 0.0;
+
+        switch (voice->envelope_state) {
+        case ENV_STATE_ATTACK: {
+            // 振幅が1.0に達するフレームからはサスティン区間として扱う
+            int ramp_frames = (int)ceil((1.0 - voice->current_amplitude) / attack_increment) - 1;
+            if (ramp_frames < 0) ramp_frames = 0;
+            segment_frames = (ramp_frames < remaining_frames) ? ramp_frames : remaining_frames;
+            gain = voice->current_amplitude + attack_increment;
+            gain_step = attack_increment;
+            if (segment_frames == ramp_frames) {
+                voice->current_amplitude = 1.0;
+                voice->envelope_state = ENV_STATE_PRESSED;
             }
-            int accidental = (accidental_char == '#') ? 1 : ((accidental_char == 'b') ? -1 : 0);
-            midi_note = 12 + (octave * 12) + base_note + accidental;
+            else {
+                voice->current_amplitude += attack_increment * segment_frames;
+            }
+            break;
+        }
+        case ENV_STATE_RELEASING: {
+            // 振幅が0.0に達したフレームは無音となり、そこで発音を終える
+            int ramp_frames = (int)ceil(voice->current_amplitude / release_decrement) - 1;
+            if (ramp_frames < 0) ramp_frames = 0;
+            segment_frames = (ramp_frames < remaining_frames) ? ramp_frames : remaining_frames;
+            gain = voice->current_amplitude - release_decrement;
+            gain_step = -release_decrement;
+            if (segment_frames == ramp_frames) {
+                voice->current_amplitude = 0.0;
+                voice->envelope_state = ENV_STATE_OFF;
+            }
+            else {
+                voice->current_amplitude -= release_decrement * segment_frames;
+            }
+            break;
+        }
+        default: break;
         }
-        g_sequence[event_index].midi_note = midi_note;
 
-        float beat_duration_ms = (60.0f / tempo) * 1000.0f;
-        float base_duration = beat_duration_ms;
-        switch (duration_char) {
-        case '2': base_duration = beat_duration_ms * 4.0f; break;
-        case '3': base_duration = beat_duration_ms * 2.0f; break;
-        case '4': base_duration = beat_duration_ms; break;
-        case '5': base_duration = beat_duration_ms / 2.0f; break;
-        case '6': base_duration = beat_duration_ms / 4.0f; break;
-        case '7': base_duration = beat_duration_ms / 8.0f; break;
+        if (table != NULL && segment_frames > 0) {
+            g_render_voice_kernel(mix_buffer + rendered_frames, table, &voice->wave_phase, phase_increment,
+                (float)gain, (float)gain_step, segment_frames);
         }
+        rendered_frames += segment_frames;
+    }
+}
 
-        g_sequence[event_index].duration_ms = (dot_char == '.') ? (base_duration * 1.5f) : base_duration;
-        event_index++;
+void trigger_note_on(int midi_note) {
+    if (midi_note <= 0 || midi_note >= MIDI_NOTE_COUNT) return;
+
+    if (g_note_keys[midi_note] >= 0) {
+        set_key_target_y(g_note_keys[midi_note], KEY_PRESSED_Y_OFFSET);
     }
+    post_audio_event(AUDIO_EVENT_NOTE_ON, midi_note);
+}
 
-    fclose(file);
-    printf("情報: 楽譜 '%s' を読み込みました (イベント数: %d)。\n", filename, g_sequence_length);
+void trigger_note_off(int midi_note) {
+    if (midi_note <= 0 || midi_note >= MIDI_NOTE_COUNT) return;
+
+    if (g_note_keys[midi_note] >= 0) {
+        set_key_target_y(g_note_keys[midi_note], 0.0f);
+    }
+    post_audio_event(AUDIO_EVENT_NOTE_OFF, midi_note);
 }
 
+// 鍵盤の表示は、実際にリリースしたノートごとにオーディオスレッドから NOTE_OFF が届いた時点で戻す
+void trigger_all_notes_off() {
+    g_mouse_held_note = 0;
+    post_audio_event(AUDIO_EVENT_ALL_NOTES_OFF, 0);
+    request_redisplay();
+}
 
-// ============================================================================
-// 描画処理
-// ============================================================================
+void post_audio_event(audio_event_type_e type, int value) {
+    // 現在のオーディオ時刻 (合成済みの末尾) を付けて送る。この時刻は常に過去になるため、次のブロックの先頭で適用される。
+    // 押した瞬間の実時間からブロック内のフレームを求めるには固定の遅延を足す必要があり、その分だけ発音が遅れるので行わない
+    ma_uint64 now = ma_atomic_load_explicit_64(&g_audio_frame_clock, ma_atomic_memory_order_acquire);
+    if (!push_audio_event(&g_audio_event_queue, type, value, now)) {
+        fprintf(stderr, "警告: オーディオイベントキューが満杯のため、イベントを破棄しました。\n");
+    }
+}
 
-void display() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+int push_audio_event(audio_event_queue_t* queue, audio_event_type_e type, int value, ma_uint64 frame_time) {
+    ma_uint32 write_index = ma_atomic_load_explicit_32(&queue->write_index, ma_atomic_memory_order_relaxed);
+    ma_uint32 read_index = ma_atomic_load_explicit_32(&queue->read_index, ma_atomic_memory_order_acquire);
+    if (write_index - read_index >= AUDIO_EVENT_QUEUE_SIZE) return 0;
 
-    int window_width = glutGet(GLUT_WINDOW_WIDTH);
-    int window_height = glutGet(GLUT_WINDOW_HEIGHT);
+    audio_event_t* event = &queue->events[write_index & (AUDIO_EVENT_QUEUE_SIZE - 1)];
+    event->type = type;
+    event->value = value;
+    event->frame_time = frame_time;
+    event->post_time_s = ma_timer_get_time_in_seconds(&g_monotonic_timer);
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluPerspective(45.0, (GLfloat)window_width / (window_height == 0 ? 1 : window_height), 0.1, 150.0);
+    // イベント本体の書き込みを済ませてから消費者側へ公開する
+    ma_atomic_store_explicit_32(&queue->write_index, write_index + 1, ma_atomic_memory_order_release);
+    return 1;
+}
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    gluLookAt(g_camera_pos[0], g_camera_pos[1], g_camera_pos[2],
-        g_camera_pos[0] + g_camera_front[0],
-        g_camera_pos[1] + g_camera_front[1],
-        g_camera_pos[2] + g_camera_front[2],
-        g_camera_up[0], g_camera_up[1], g_camera_up[2]);
+audio_event_t* peek_audio_event(audio_event_queue_t* queue) {
+    ma_uint32 read_index = ma_atomic_load_explicit_32(&queue->read_index, ma_atomic_memory_order_relaxed);
+    ma_uint32 write_index = ma_atomic_load_explicit_32(&queue->write_index, ma_atomic_memory_order_acquire);
+    if (read_index == write_index) return NULL;
+    return &queue->events[read_index & (AUDIO_EVENT_QUEUE_SIZE - 1)];
+}
 
-    GLfloat light_pos[] = { 0.0f, 5.0f, 5.0f, 1.0f };
-    glLightfv(GL_LIGHT0, GL_POSITION, light_pos);
+void pop_audio_event(audio_event_queue_t* queue) {
+    ma_uint32 read_index = ma_atomic_load_explicit_32(&queue->read_index, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_32(&queue->read_index, read_index + 1, ma_atomic_memory_order_release);
+}
 
-    draw_floor();
-    draw_piano_body();
-    draw_piano_keys();
-    draw_buttons();
-    draw_hud();
-    draw_reticle();
+void apply_audio_event(const audio_event_t* event) {
+    switch (event->type) {
+    case AUDIO_EVENT_NOTE_ON:
+        start_note_voice(event->value);
+        record_input_latency(event->post_time_s);
+        break;
+    case AUDIO_EVENT_NOTE_OFF:
+        release_note_voice(event->value);
+        break;
+    case AUDIO_EVENT_SET_TIMBRE:
+        if (event->value >= 0 && event->value < TIMBRE_BUTTON_COUNT) {
+            g_audio_timbre_index = event->value;
+        }
+        break;
+    case AUDIO_EVENT_SET_OCTAVE:
+        g_audio_octave_shift = event->value;
+        break;
+    case AUDIO_EVENT_SEQ_START:
+        // 要求時刻ではなく実際に受け取ったコールバックの先頭から拍を数える
+        start_sequencer(event->frame_time > g_audio_frame_clock ? event->frame_time : g_audio_frame_clock);
+        break;
+    case AUDIO_EVENT_SEQ_STOP:
+        stop_sequencer(0);
+        break;
+    case AUDIO_EVENT_ALL_NOTES_OFF:
+        release_all_voices();
+        break;
+    default: break;
+    }
+}
 
-    glutSwapBuffers();
+// 同じノートが押されたままなら離鍵させ、新しいボイスを重ねて鳴らす (リリース中の音も途切れない)
+void start_note_voice(int midi_note) {
+    if (midi_note <= 0 || midi_note >= MIDI_NOTE_COUNT) return;
+    release_note_voice(midi_note);
+
+    int voice_index = allocate_voice();
+    voice_t* voice = &g_voices[voice_index];
+    voice->midi_note = midi_note;
+    voice->envelope_state = ENV_STATE_ATTACK;
+    voice->wave_phase = 0.0;
+    voice->current_amplitude = 0.0;
+    voice->release_decrement = 1.0 / (g_audio_config.sample_rate * AUDIO_RELEASE_TIME_S);
+    voice->start_order = g_voice_start_counter++;
+    voice->is_stolen = 0;
+
+    g_active_voices[g_active_voice_count++] = voice_index;
+    g_note_voices[midi_note] = voice_index;
 }
 
-void draw_floor() {
-    GLfloat floor_mat_ambient[] = { 0.9f, 0.9f, 0.9f, 1.0f };
-    GLfloat floor_mat_diffuse[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+void release_note_voice(int midi_note) {
+    if (midi_note <= 0 || midi_note >= MIDI_NOTE_COUNT) return;
 
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, g_texture_wood);
+    int voice_index = g_note_voices[midi_note];
+    if (voice_index < 0) return;
+    g_note_voices[midi_note] = -1;
 
-    glMaterialfv(GL_FRONT, GL_AMBIENT, floor_mat_ambient);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, floor_mat_diffuse);
+    voice_t* voice = &g_voices[voice_index];
+    if (voice->envelope_state == ENV_STATE_ATTACK || voice->envelope_state == ENV_STATE_PRESSED) {
+        voice->envelope_state = ENV_STATE_RELEASING;
+    }
+}
 
-    glBegin(GL_QUADS);
-    glNormal3f(0.0f, 1.0f, 0.0f);
-    glTexCoord2f(0.0f, 0.0f);   glVertex3f(-100.0f, -1.8f, -100.0f);
-    glTexCoord2f(20.0f, 0.0f);  glVertex3f(100.0f, -1.8f, -100.0f);
-    glTexCoord2f(20.0f, 20.0f); glVertex3f(100.0f, -1.8f, 100.0f);
-    glTexCoord2f(0.0f, 20.0f);  glVertex3f(-100.0f, -1.8f, 100.0f);
-    glEnd();
+// 鍵盤の数ではなく発音中のボイス数に比例する。押鍵中だったノートはUIスレッドへ離鍵を通知する
+void release_all_voices() {
+    for (int v = 0; v < g_active_voice_count; ++v) {
+        int voice_index = g_active_voices[v];
+        voice_t* voice = &g_voices[voice_index];
+        if (g_note_voices[voice->midi_note] != voice_index) continue;
 
-    glDisable(GL_TEXTURE_2D);
+        g_note_voices[voice->midi_note] = -1;
+        if (voice->envelope_state == ENV_STATE_ATTACK || voice->envelope_state == ENV_STATE_PRESSED) {
+            voice->envelope_state = ENV_STATE_RELEASING;
+        }
+        push_audio_event(&g_ui_event_queue, AUDIO_EVENT_NOTE_OFF, voice->midi_note, g_audio_frame_clock);
+    }
 }
 
-void draw_piano_body() {
-    glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_BLACK_PLASTIC_AMBIENT);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_BLACK_PLASTIC_DIFFUSE);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_BLACK_PLASTIC_SPECULAR);
-    glMaterialf(GL_FRONT, GL_SHININESS, MAT_BLACK_PLASTIC_SHININESS);
+// 同時発音数が上限に達していれば1つ奪ってから、未使用のボイスを取り出す
+int allocate_voice() {
+    if (g_active_voice_count >= g_max_polyphony) {
+        int sounding_count = 0;
+        for (int v = 0; v < g_active_voice_count; ++v) {
+            const voice_t* voice = &g_voices[g_active_voices[v]];
+            if (!voice->is_stolen && voice->envelope_state != ENV_STATE_OFF) sounding_count++;
+        }
+        if (sounding_count >= g_max_polyphony) steal_voice();
+    }
 
-    glPushMatrix();
-    glTranslatef(-3.5f, -0.8f, 1.5f);
-    glCallList(g_model_piano_body.display_list_id);
-    glPopMatrix();
+    if (g_free_voice_count == 0) {
+        // フェード中のボイスでプールが埋まっている時だけ、奪われたボイスを優先して最も小さい音をその場で打ち切る
+        int quietest = 0;
+        for (int v = 1; v < g_active_voice_count; ++v) {
+            const voice_t* voice = &g_voices[g_active_voices[v]];
+            const voice_t* candidate = &g_voices[g_active_voices[quietest]];
+            if (voice->is_stolen != candidate->is_stolen) {
+                if (voice->is_stolen) quietest = v;
+            }
+            else if (voice->current_amplitude < candidate->current_amplitude) {
+                quietest = v;
+            }
+        }
+        int voice_index = g_active_voices[quietest];
+        if (g_note_voices[g_voices[voice_index].midi_note] == voice_index) {
+            g_note_voices[g_voices[voice_index].midi_note] = -1;
+        }
+        g_active_voices[quietest] = g_active_voices[--g_active_voice_count];
+        return voice_index;
+    }
+    return g_free_voices[--g_free_voice_count];
 }
 
-void draw_piano_keys() {
-    for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
-        piano_key_t* key = &g_piano_keys[i];
-        glPushMatrix();
+// リリース中で最も小さい音、無ければ最も古い音を短いフェードで止める
+void steal_voice() {
+    voice_t* victim = NULL;
+    for (int v = 0; v < g_active_voice_count; ++v) {
+        voice_t* voice = &g_voices[g_active_voices[v]];
+        if (voice->is_stolen || voice->envelope_state == ENV_STATE_OFF) continue;
 
-        glTranslatef(key->center_pos[0], key->center_pos[1], key->center_pos[2]);
-        glTranslatef(0.0f, key->current_y_pos, 0.0f);
+        if (victim == NULL) {
+            victim = voice;
+        }
+        else if (voice->envelope_state == ENV_STATE_RELEASING) {
+            if (victim->envelope_state != ENV_STATE_RELEASING || voice->current_amplitude < victim->current_amplitude) victim = voice;
+        }
+        else if (victim->envelope_state != ENV_STATE_RELEASING && voice->start_order < victim->start_order) {
+            victim = voice;
+        }
+    }
+    if (victim == NULL) return;
 
-        if (key->type == KEY_TYPE_WHITE) {
-            glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_IVORY_AMBIENT);
-            glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_IVORY_DIFFUSE);
-            glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_IVORY_SPECULAR);
-            glMaterialf(GL_FRONT, GL_SHININESS, MAT_IVORY_SHININESS);
-            glCallList(g_model_white_key.display_list_id);
+    int victim_index = (int)(victim - g_voices);
+    if (g_note_voices[victim->midi_note] == victim_index) {
+        g_note_voices[victim->midi_note] = -1;
+    }
+    victim->is_stolen = 1;
+    victim->envelope_state = ENV_STATE_RELEASING;
+    victim->release_decrement = 1.0 / (g_audio_config.sample_rate * VOICE_STEAL_FADE_TIME_S);
+}
+
+// ============================================================================
+// 並列音声合成
+// ============================================================================
+
+// ボイスは互いに独立しているので、発音中ボイス一覧を剰余で分けるだけで同期なしに並列に合成できる
+void start_render_workers() {
+    if (g_render_thread_count <= 1 || g_render_worker_count > 0) return;
+
+    // コア数を超えるとスピン待ちが互いの実行を妨げるため、コア数までに抑える
+    int thread_count = g_render_thread_count;
+    int core_count = get_cpu_core_count();
+    if (thread_count > core_count && !g_is_render_thread_count_forced) {
+        printf("警告: 合成スレッド数をコア数 (%d) に合わせます。\n", core_count);
+        thread_count = core_count;
+        if (thread_count <= 1) return;
+    }
+
+    if (ma_semaphore_init(0, &g_render_wake_semaphore) != MA_SUCCESS) {
+        fprintf(stderr, "警告: 合成スレッドの同期オブジェクトを作成できません。1スレッドで合成します。\n");
+        return;
+    }
+    ma_atomic_store_explicit_32(&g_is_render_shutdown, 0, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_32(&g_is_render_session_active, 0, ma_atomic_memory_order_relaxed);
+    g_is_synthesis_thread_pinned = 0;
+
+    for (int i = 0; i < thread_count - 1; ++i) {
+        render_worker_t* worker = &g_render_workers[i];
+        worker->partition_index = i + 1;
+        worker->last_generation = ma_atomic_load_explicit_32(&g_render_generation, ma_atomic_memory_order_relaxed);
+        if (ma_thread_create(&worker->thread, ma_thread_priority_highest, 0, render_worker_thread, worker, NULL) != MA_SUCCESS) {
+            fprintf(stderr, "警告: 合成スレッドを作成できません。%d スレッドで合成します。\n", g_render_worker_count + 1);
+            break;
         }
-        else {
-            glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_BLACK_MATTE_AMBIENT);
-            glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_BLACK_MATTE_DIFFUSE);
-            glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_BLACK_MATTE_SPECULAR);
-            glMaterialf(GL_FRONT, GL_SHININESS, MAT_BLACK_MATTE_SHININESS);
-            glCallList(g_model_black_key.display_list_id);
+        g_render_worker_count++;
+    }
+    if (g_render_worker_count == 0) {
+        ma_semaphore_uninit(&g_render_wake_semaphore);
+        return;
+    }
+    printf("情報: 音声合成を %d スレッドに分割します (発音数 %d 以上の時)。\n", g_render_worker_count + 1, RENDER_PARALLEL_MIN_VOICES);
+}
+
+void stop_render_workers() {
+    if (g_render_worker_count == 0) return;
+
+    ma_atomic_store_explicit_32(&g_is_render_shutdown, 1, ma_atomic_memory_order_release);
+    for (int i = 0; i < g_render_worker_count; ++i) {
+        ma_semaphore_release(&g_render_wake_semaphore);
+    }
+    for (int i = 0; i < g_render_worker_count; ++i) {
+        ma_thread_wait(&g_render_workers[i].thread);
+    }
+    ma_semaphore_uninit(&g_render_wake_semaphore);
+    g_render_worker_count = 0;
+}
+
+ma_thread_result MA_THREADCALL render_worker_thread(void* data) {
+    render_worker_t* worker = (render_worker_t*)data;
+    pin_render_thread(worker->partition_index);
+
+    for (;;) {
+        ma_semaphore_wait(&g_render_wake_semaphore);
+        if (ma_atomic_load_explicit_32(&g_is_render_shutdown, ma_atomic_memory_order_acquire)) break;
+
+        // コールバックが終わるまではスピンし、ブロックごとにカーネルを経由せず次の仕事を受け取る
+        int spin_count = 0;
+        for (;;) {
+            ma_uint32 generation = ma_atomic_load_explicit_32(&g_render_generation, ma_atomic_memory_order_acquire);
+            if (generation != worker->last_generation) {
+                spin_count = 0;
+                const render_job_t* job = &g_render_job;
+                worker->last_generation = generation;
+                memset(worker->mix_buffer, 0, sizeof(float) * job->block_frames);
+                for (int v = worker->partition_index; v < g_active_voice_count; v += job->partition_count) {
+                    render_voice_block(&g_voices[g_active_voices[v]], job->timbre, job->octave_shift, worker->mix_buffer, job->block_frames);
+                }
+                ma_atomic_fetch_add_explicit_32(&g_render_finished_count, 1, ma_atomic_memory_order_release);
+            }
+            else if (!ma_atomic_load_explicit_32(&g_is_render_session_active, ma_atomic_memory_order_acquire)) {
+                break;
+            }
+            else {
+                wait_render_spin(&spin_count);
+            }
         }
-
-        glPopMatrix();
     }
+    return (ma_thread_result)0;
 }
 
-void draw_buttons() {
-    glMaterialfv(GL_FRONT, GL_AMBIENT, MAT_GREY_PLASTIC_AMBIENT);
-    glMaterialfv(GL_FRONT, GL_DIFFUSE, MAT_GREY_PLASTIC_DIFFUSE);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, MAT_GREY_PLASTIC_SPECULAR);
-    glMaterialf(GL_FRONT, GL_SHININESS, MAT_GREY_PLASTIC_SHININESS);
+// 合成スレッド (コールバックまたは先行合成) をコア0、ワーカー i をコア i に固定する。
+// Windows と Linux だけで行い、コア数が足りない場合や他の環境ではOSに任せる (固定できなくても動作は変わらない)
+void pin_render_thread(int core_index) {
+    if (core_index >= get_cpu_core_count()) return;
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core_index);
+#elif defined(__linux__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core_index, &cpu_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#endif
+}
 
-    for (int i = 0; i < TIMBRE_BUTTON_COUNT; ++i) {
-        glPushMatrix();
-        glTranslatef(TIMBRE_BUTTON_X_POSITIONS[i], BUTTON_Y, BUTTON_Z);
-        glCallList(g_model_timbre_button.display_list_id);
-        glPopMatrix();
+// 仕事の内容を書いてから世代番号を進めて公開する。ワーカーを起こすのはコールバックごとに最初の1回だけ
+void dispatch_render_workers(const timbre_t* timbre, int octave_shift, int block_frames) {
+    g_render_job.timbre = timbre;
+    g_render_job.octave_shift = octave_shift;
+    g_render_job.block_frames = block_frames;
+    g_render_job.partition_count = g_render_worker_count + 1;
+    ma_atomic_store_explicit_32(&g_render_finished_count, 0, ma_atomic_memory_order_relaxed);
+
+    if (!ma_atomic_load_explicit_32(&g_is_render_session_active, ma_atomic_memory_order_relaxed)) {
+        ma_atomic_store_explicit_32(&g_is_render_session_active, 1, ma_atomic_memory_order_relaxed);
+        for (int i = 0; i < g_render_worker_count; ++i) {
+            ma_semaphore_release(&g_render_wake_semaphore);
+        }
     }
+    ma_atomic_fetch_add_explicit_32(&g_render_generation, 1, ma_atomic_memory_order_release);
+}
 
-    for (int i = 0; i < OCTAVE_BUTTON_COUNT; ++i) {
-        glPushMatrix();
-        glTranslatef(OCTAVE_BUTTON_POSITIONS[i][0], OCTAVE_BUTTON_POSITIONS[i][1], OCTAVE_BUTTON_POSITIONS[i][2]);
-        glRotatef(OCTAVE_BUTTON_POSITIONS[i][3], 0.0f, 1.0f, 0.0f);
-        glCallList(g_model_octave_button.display_list_id);
-        glPopMatrix();
+// 全ワーカーの終了を待って (ロックを使わないバリア)、各ワーカーのバッファを足し込む
+void collect_render_workers(int block_frames) {
+    int spin_count = 0;
+    while (ma_atomic_load_explicit_32(&g_render_finished_count, ma_atomic_memory_order_acquire) < (ma_uint32)g_render_worker_count) {
+        wait_render_spin(&spin_count);
+    }
+    for (int w = 0; w < g_render_worker_count; ++w) {
+        const float* worker_buffer = g_render_workers[w].mix_buffer;
+        for (int i = 0; i < block_frames; ++i) {
+            g_mix_buffer[i] += worker_buffer[i];
+        }
     }
 }
 
-void draw_hud() {
-    int window_width = glutGet(GLUT_WINDOW_WIDTH);
-    int window_height = glutGet(GLUT_WINDOW_HEIGHT);
-    char text_buffer[256];
+// 通常は数百ナノ秒で終わる待ちなのでスピンするが、長引いた時 (他の処理にコアを取られた時など) はOSに譲る
+void wait_render_spin(int* spin_count) {
+    if (++*spin_count < RENDER_SPIN_LIMIT) {
+        ma_yield();
+        return;
+    }
+#if defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
 
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    gluOrtho2D(0, window_width, 0, window_height);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
+// コールバックの終わりにワーカーをセマフォ待ちへ戻し、次のコールバックまでCPUを手放させる
+void park_render_workers() {
+    if (g_render_worker_count > 0) {
+        ma_atomic_store_explicit_32(&g_is_render_session_active, 0, ma_atomic_memory_order_release);
+    }
+}
 
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
 
-    glColor3f(1.0f, 1.0f, 1.0f);
-    sprintf_s(text_buffer, sizeof(text_buffer), "Octave: %+d", g_current_octave_shift);
-    glRasterPos2i(HUD_MARGIN_X, window_height - HUD_MARGIN_Y);
-    for (int i = 0; text_buffer[i] != '\0'; ++i) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, text_buffer[i]);
-    }
+// ============================================================================
+// 先行合成
+// ============================================================================
 
-    sprintf_s(text_buffer, sizeof(text_buffer), "Timbre: %s", g_timbres[g_current_timbre_index].name);
-    glRasterPos2i(HUD_MARGIN_X, window_height - HUD_MARGIN_Y - HUD_LINE_HEIGHT);
-    for (int i = 0; text_buffer[i] != '\0'; ++i) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, text_buffer[i]);
-    }
+// デバイスは開始直後にバッファ全体 (周期 × 周期数) を一度に要求するため、リングバッファは先行量 + デバイスバッファ分を持ち、
+// 満杯にしてからデバイスを開始する。その後の合成スレッドは先行量 + 1周期分だけを保つ
+int start_render_ahead(ma_uint32 device_period_frames, ma_uint32 device_period_count) {
+    g_render_ahead_frames = (ma_uint32)((ma_uint64)g_render_ahead_ms * g_audio_config.sample_rate / 1000);
+    if (g_render_ahead_frames < RENDER_AHEAD_CHUNK_FRAMES) g_render_ahead_frames = RENDER_AHEAD_CHUNK_FRAMES;
+    if (device_period_count < 1) device_period_count = 1;
+    ma_uint32 capacity_frames = g_render_ahead_frames + device_period_frames * device_period_count;
 
-    if (g_is_sequencer_playing) {
-        glColor3f(0.0f, 1.0f, 0.0f);
-        sprintf_s(text_buffer, sizeof(text_buffer), "Sequencer: Playing");
+    if (ma_pcm_rb_init(ma_format_f32, 2, capacity_frames, NULL, NULL, &g_render_ahead_buffer) != MA_SUCCESS) {
+        g_render_ahead_frames = 0;
+        return 0;
     }
-    else {
-        glColor3f(1.0f, 1.0f, 1.0f);
-        sprintf_s(text_buffer, sizeof(text_buffer), "Sequencer: Stopped");
+    if (ma_event_init(&g_render_ahead_event) != MA_SUCCESS) {
+        ma_pcm_rb_uninit(&g_render_ahead_buffer);
+        g_render_ahead_frames = 0;
+        return 0;
     }
-    glRasterPos2i(HUD_MARGIN_X, window_height - HUD_MARGIN_Y - (HUD_LINE_HEIGHT * 2));
-    for (int i = 0; text_buffer[i] != '\0'; ++i) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, text_buffer[i]);
+    ma_atomic_store_explicit_32(&g_audio_timing_stats.min_fill_frames, capacity_frames, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_32(&g_render_ahead_fill_target, capacity_frames, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_32(&g_is_render_ahead_shutdown, 0, ma_atomic_memory_order_relaxed);
+    ma_atomic_store_explicit_32(&g_is_render_ahead_exited, 0, ma_atomic_memory_order_relaxed);
+    if (ma_thread_create(&g_render_ahead_thread, ma_thread_priority_highest, 0, render_ahead_thread, NULL, NULL) != MA_SUCCESS) {
+        ma_event_uninit(&g_render_ahead_event);
+        ma_pcm_rb_uninit(&g_render_ahead_buffer);
+        g_render_ahead_frames = 0;
+        return 0;
     }
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHTING);
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
+    // 1チャンクも書けなくなるまで待ってから返し、デバイス開始直後のまとめ読みでアンダーランしないようにする。
+    // 合成スレッドが途中で終了したか時間内に満たせなければ、先行合成をやめて呼び出し元に直接合成させる
+    double prefill_start_s = ma_timer_get_time_in_seconds(&g_monotonic_timer);
+    while (ma_pcm_rb_available_write(&g_render_ahead_buffer) >= RENDER_AHEAD_CHUNK_FRAMES) {
+        if (ma_atomic_load_explicit_32(&g_is_render_ahead_exited, ma_atomic_memory_order_acquire) ||
+            ma_timer_get_time_in_seconds(&g_monotonic_timer) - prefill_start_s > RENDER_AHEAD_PREFILL_TIMEOUT_MS / 1000.0) {
+            fprintf(stderr, "警告: 先行合成のリングバッファを満たせませんでした。\n");
+            ma_atomic_store_explicit_32(&g_is_render_ahead_shutdown, 1, ma_atomic_memory_order_release);
+            ma_event_signal(&g_render_ahead_event);
+            ma_thread_wait(&g_render_ahead_thread);
+            ma_event_uninit(&g_render_ahead_event);
+            ma_pcm_rb_uninit(&g_render_ahead_buffer);
+            g_render_ahead_frames = 0;
+            return 0;
+        }
+        ma_sleep(1);
+    }
+    ma_atomic_store_explicit_32(&g_render_ahead_fill_target, g_render_ahead_frames + device_period_frames, ma_atomic_memory_order_relaxed);
+
+    ma_atomic_store_explicit_32(&g_is_render_ahead_running, 1, ma_atomic_memory_order_release);
+    printf("情報: %.1f ms 先行して合成します (デバイス周期: %u フレーム)。\n",
+        g_render_ahead_frames * 1.0e3 / g_audio_config.sample_rate, device_period_frames);
+    return 1;
 }
 
-void draw_reticle() {
-    int w = glutGet(GLUT_WINDOW_WIDTH);
-    int h = glutGet(GLUT_WINDOW_HEIGHT);
+// デバイスを止めてから呼ぶ (コールバックがリングバッファを読んでいないこと)
+void stop_render_ahead() {
+    if (!ma_atomic_load_explicit_32(&g_is_render_ahead_running, ma_atomic_memory_order_acquire)) return;
 
-    glMatrixMode(GL_PROJECTION);
-    glPushMatrix();
-    glLoadIdentity();
-    gluOrtho2D(0, w, 0, h);
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glLoadIdentity();
+    ma_atomic_store_explicit_32(&g_is_render_ahead_shutdown, 1, ma_atomic_memory_order_release);
+    ma_event_signal(&g_render_ahead_event);
+    ma_thread_wait(&g_render_ahead_thread);
+    ma_atomic_store_explicit_32(&g_is_render_ahead_running, 0, ma_atomic_memory_order_release);
+    ma_event_uninit(&g_render_ahead_event);
+    ma_pcm_rb_uninit(&g_render_ahead_buffer);
+}
 
-    glDisable(GL_LIGHTING);
-    glDisable(GL_DEPTH_TEST);
+// 残量が目標に届かず1チャンク分の空きがある限り合成し、それ以外はデバイスが読み出すまで眠る
+ma_thread_result MA_THREADCALL render_ahead_thread(void* data) {
+    (void)data;
+    while (!ma_atomic_load_explicit_32(&g_is_render_ahead_shutdown, ma_atomic_memory_order_acquire)) {
+        if (ma_pcm_rb_available_write(&g_render_ahead_buffer) < RENDER_AHEAD_CHUNK_FRAMES
+            || ma_pcm_rb_available_read(&g_render_ahead_buffer) >= ma_atomic_load_explicit_32(&g_render_ahead_fill_target, ma_atomic_memory_order_relaxed)) {
+            ma_event_wait(&g_render_ahead_event);
+            continue;
+        }
 
-    glColor3f(0.0f, 1.0f, 0.0f);
-    glBegin(GL_LINES);
-    glVertex2f(w / 2.0f - RETICLE_SIZE, h / 2.0f);
-    glVertex2f(w / 2.0f + RETICLE_SIZE, h / 2.0f);
-    glVertex2f(w / 2.0f, h / 2.0f - RETICLE_SIZE);
-    glVertex2f(w / 2.0f, h / 2.0f + RETICLE_SIZE);
-    glEnd();
+        // 末尾で折り返す場合は書ける分だけ合成し、残りは次の周回で書く
+        ma_uint32 frame_count = RENDER_AHEAD_CHUNK_FRAMES;
+        void* buffer;
+        if (ma_pcm_rb_acquire_write(&g_render_ahead_buffer, &frame_count, &buffer) != MA_SUCCESS || frame_count == 0) break;
+        double chunk_start_s = ma_timer_get_time_in_seconds(&g_monotonic_timer);
+        synthesize_audio((float*)buffer, frame_count);
+        record_render_ahead_chunk_timing(chunk_start_s, frame_count);
+        ma_pcm_rb_commit_write(&g_render_ahead_buffer, frame_count);
+    }
+    ma_atomic_store_explicit_32(&g_is_render_ahead_exited, 1, ma_atomic_memory_order_release);
+    return (ma_thread_result)0;
+}
 
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_LIGHTING);
-    glMatrixMode(GL_PROJECTION);
-    glPopMatrix();
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
+// 書き込むのはデバイスのコールバックだけなので、統計は読み込み→更新→格納でよい
+void read_render_ahead_frames(float* output_buffer, ma_uint32 frame_count) {
+    audio_timing_stats_t* stats = &g_audio_timing_stats;
+    ma_uint32 fill_frames = ma_pcm_rb_available_read(&g_render_ahead_buffer);
+    ma_atomic_store_explicit_32(&stats->last_fill_frames, fill_frames, ma_atomic_memory_order_relaxed);
+    if (fill_frames < stats->min_fill_frames) {
+        ma_atomic_store_explicit_32(&stats->min_fill_frames, fill_frames, ma_atomic_memory_order_relaxed);
+    }
+
+    ma_uint32 copied_frames = 0;
+    while (copied_frames < frame_count) {
+        ma_uint32 chunk_frames = frame_count - copied_frames;
+        void* buffer;
+        if (ma_pcm_rb_acquire_read(&g_render_ahead_buffer, &chunk_frames, &buffer) != MA_SUCCESS || chunk_frames == 0) break;
+        memcpy(output_buffer + copied_frames * 2, buffer, sizeof(float) * 2 * chunk_frames);
+        ma_pcm_rb_commit_read(&g_render_ahead_buffer, chunk_frames);
+        copied_frames += chunk_frames;
+    }
+
+    // 合成が追いつかなかった分は無音で埋めて数える (リングバッファには後から続きが書かれる)
+    if (copied_frames < frame_count) {
+        memset(output_buffer + copied_frames * 2, 0, sizeof(float) * 2 * (frame_count - copied_frames));
+        ma_atomic_store_explicit_64(&stats->underrun_count, stats->underrun_count + 1, ma_atomic_memory_order_relaxed);
+    }
+    ma_event_signal(&g_render_ahead_event);
 }
 
 
 // ============================================================================
-// 入力・イベント処理
+// 音声合成カーネル
 // ============================================================================
 
-void on_mouse_button(int button, int state, int x, int y) {
-    if (button != GLUT_LEFT_BUTTON) return;
+void select_voice_render_kernel() {
+    g_render_voice_kernel = render_voice_scalar;
+    g_render_voice_kernel_name = "Scalar";
 
-    if (state == GLUT_DOWN) {
-        vector_3d_t click_pos = get_world_pos_from_screen_center();
-        int is_object_found = 0;
-
-        for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
-            piano_key_t* key = &g_piano_keys[i];
-            model_3d_t* model = (key->type == KEY_TYPE_WHITE) ? &g_model_white_key : &g_model_black_key;
-            bounding_box_t world_bbox;
-            world_bbox.min.x = key->center_pos[0] + model->local_bbox.min.x;
-            world_bbox.max.x = key->center_pos[0] + model->local_bbox.max.x;
-            world_bbox.min.y = key->center_pos[1] + model->local_bbox.min.y;
-            world_bbox.max.y = key->center_pos[1] + model->local_bbox.max.y;
-            world_bbox.min.z = key->center_pos[2] + model->local_bbox.min.z;
-            world_bbox.max.z = key->center_pos[2] + model->local_bbox.max.z;
-
-            if (is_point_in_box(click_pos, world_bbox)) {
-                trigger_note_on(key->midi_note);
-                is_object_found = 1;
-                break;
-            }
+#if defined(PIANO_SIMD_X86)
+    voice_render_kernel_t candidate = render_voice_sse2;
+    const char* candidate_name = "SSE2";
+    if (cpu_supports_avx2()) {
+        candidate = render_voice_avx2;
+        candidate_name = "AVX2";
+    }
+#elif defined(PIANO_SIMD_NEON)
+    voice_render_kernel_t candidate = render_voice_neon;
+    const char* candidate_name = "NEON";
+#else
+    voice_render_kernel_t candidate = NULL;
+    const char* candidate_name = NULL;
+#endif
+
+    if (candidate != NULL) {
+        // スカラー版との差が許容誤差を超えるカーネルは採用しない
+        float max_error = measure_voice_render_kernel_error(candidate);
+        if (max_error < 0.0f) {
+            fprintf(stderr, "警告: 検証に使えるウェーブテーブルが無いため、%s合成カーネルを検証できません。スカラー版を使用します。\n", candidate_name);
         }
-        if (is_object_found) { glutPostRedisplay(); return; }
-
-        for (int i = 0; i < TIMBRE_BUTTON_COUNT; ++i) {
-            bounding_box_t world_bbox;
-            world_bbox.min.x = TIMBRE_BUTTON_X_POSITIONS[i] + g_model_timbre_button.local_bbox.min.x;
-            world_bbox.max.x = TIMBRE_BUTTON_X_POSITIONS[i] + g_model_timbre_button.local_bbox.max.x;
-            world_bbox.min.y = BUTTON_Y + g_model_timbre_button.local_bbox.min.y;
-            world_bbox.max.y = BUTTON_Y + g_model_timbre_button.local_bbox.max.y;
-            world_bbox.min.z = BUTTON_Z + g_model_timbre_button.local_bbox.min.z;
-            world_bbox.max.z = BUTTON_Z + g_model_timbre_button.local_bbox.max.z;
-
-            if (is_point_in_box(click_pos, world_bbox)) {
-                printf("情報: 音色を「%s」に変更しました。\n", g_timbres[i].name);
-                g_current_timbre_index = i;
-                is_object_found = 1;
-                break;
-            }
+        else if (max_error <= AUDIO_KERNEL_TOLERANCE) {
+            g_render_voice_kernel = candidate;
+            g_render_voice_kernel_name = candidate_name;
         }
-        if (is_object_found) { glutPostRedisplay(); return; }
-
-        for (int i = 0; i < OCTAVE_BUTTON_COUNT; ++i) {
-            bounding_box_t world_bbox;
-            world_bbox.min.x = OCTAVE_BUTTON_POSITIONS[i][0] + g_model_octave_button.local_bbox.min.x;
-            world_bbox.max.x = OCTAVE_BUTTON_POSITIONS[i][0] + g_model_octave_button.local_bbox.max.x;
-            world_bbox.min.y = OCTAVE_BUTTON_POSITIONS[i][1] + g_model_octave_button.local_bbox.min.y;
-            world_bbox.max.y = OCTAVE_BUTTON_POSITIONS[i][1] + g_model_octave_button.local_bbox.max.y;
-            world_bbox.min.z = OCTAVE_BUTTON_POSITIONS[i][2] + g_model_octave_button.local_bbox.min.z;
-            world_bbox.max.z = OCTAVE_BUTTON_POSITIONS[i][2] + g_model_octave_button.local_bbox.max.z;
-
-            if (is_point_in_box(click_pos, world_bbox)) {
-                if (i == 0) { // Octave Down
-                    if (g_current_octave_shift > OCTAVE_SHIFT_MIN) {
-                        g_current_octave_shift--;
-                        printf("情報: オクターブを下げました (%+d)。\n", g_current_octave_shift);
-                    }
-                    
-                }
-                else { // Octave Up
-                    if (g_current_octave_shift < OCTAVE_SHIFT_MAX) {
-                        g_current_octave_shift++;
-                        printf("情報: オクターブを上げました (%+d)。\n", g_current_octave_shift);
-                    }
-                }
-                is_object_found = 1;
-                break;
-            }
+        else {
+            fprintf(stderr, "警告: %s合成カーネルの誤差が許容値を超えました (%g)。スカラー版を使用します。\n", candidate_name, max_error);
         }
-        if (is_object_found) { glutPostRedisplay(); return; }
-
     }
-    else if (state == GLUT_UP) {
-        for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
-            trigger_note_off(g_piano_keys[i].midi_note);
+    printf("情報: 音声合成カーネル: %s\n", g_render_voice_kernel_name);
+}
+
+float measure_voice_render_kernel_error(voice_render_kernel_t kernel) {
+    const int frame_count = AUDIO_RENDER_BLOCK_FRAMES - 1; // 端数処理も検証するためベクトル幅の倍数にしない
+    const int test_notes[] = { 24, 60, 69, 96, 108 };
+    float expected[AUDIO_RENDER_BLOCK_FRAMES];
+    float actual[AUDIO_RENDER_BLOCK_FRAMES];
+    const float gain_step = 1.0f / frame_count;
+    float max_error = 0.0f;
+    int tested_count = 0;
+
+    for (int t = 0; t < TIMBRE_BUTTON_COUNT; ++t) {
+        for (int n = 0; n < (int)(sizeof(test_notes) / sizeof(test_notes[0])); ++n) {
+            const float* table = get_wavetable_for_note(&g_timbres[t], test_notes[n]);
+            if (table == NULL) continue;
+            tested_count++;
+
+            double phase_increment = midi_to_freq(test_notes[n]) / g_audio_config.sample_rate;
+            double expected_phase = 0.7;
+            double actual_phase = 0.7;
+            memset(expected, 0, sizeof(expected));
+            memset(actual, 0, sizeof(actual));
+
+            render_voice_scalar(expected, table, &expected_phase, phase_increment, 0.0f, gain_step, frame_count);
+            kernel(actual, table, &actual_phase, phase_increment, 0.0f, gain_step, frame_count);
+
+            for (int i = 0; i < frame_count; ++i) {
+                float error = fabsf(expected[i] - actual[i]);
+                if (error > max_error) max_error = error;
+            }
+            double phase_error = fabs(expected_phase - actual_phase);
+            if (phase_error > 0.5) phase_error = 1.0 - phase_error;
+            if (phase_error > 1.0e-9) return INFINITY;
         }
-        glutPostRedisplay();
     }
+    return tested_count > 0 ? max_error : -1.0f;    // 1つも比べられなければ負の値 (検証できなかった)
 }
 
-void on_keyboard_press(unsigned char key, int x, int y) {
-    float front_h_x = g_camera_front[0];
-    float front_h_z = g_camera_front[2];
-    float len = sqrt(front_h_x * front_h_x + front_h_z * front_h_z);
-    if (len > 0) {
-        front_h_x /= len;
-        front_h_z /= len;
-    }
-    float right_h_x = -front_h_z;
-    float right_h_z = front_h_x;
+void render_voice_scalar(float* mix_buffer, const float* table, double* phase, double phase_increment, float gain, float gain_step, int frame_count) {
+    double current_phase = *phase;
 
-    switch (key) {
-    case 'w': g_camera_pos[0] += front_h_x * CAMERA_MOVE_SPEED; g_camera_pos[2] += front_h_z * CAMERA_MOVE_SPEED; break;
-    case 's': g_camera_pos[0] -= front_h_x * CAMERA_MOVE_SPEED; g_camera_pos[2] -= front_h_z * CAMERA_MOVE_SPEED; break;
-    case 'a': g_camera_pos[0] -= right_h_x * CAMERA_MOVE_SPEED; g_camera_pos[2] -= right_h_z * CAMERA_MOVE_SPEED; break;
-    case 'd': g_camera_pos[0] += right_h_x * CAMERA_MOVE_SPEED; g_camera_pos[2] += right_h_z * CAMERA_MOVE_SPEED; break;
-    case 'q': g_camera_pos[1] += CAMERA_MOVE_SPEED; break;
-    case 'e': g_camera_pos[1] -= CAMERA_MOVE_SPEED; break;
-    case 27:  exit(0); break;
+    for (int i = 0; i < frame_count; ++i) {
+        double table_pos = current_phase * WAVETABLE_SIZE;
+        int table_index = (int)table_pos;
+        float frac = (float)(table_pos - table_index);
+        float sample = table[table_index] + frac * (table[table_index + 1] - table[table_index]);
+
+        mix_buffer[i] += (gain + gain_step * (float)i) * sample;
+
+        current_phase += phase_increment;
+        if (current_phase >= 1.0) {
+            current_phase = wrap_phase(current_phase);
+        }
     }
-    glutPostRedisplay();
+    *phase = current_phase;
 }
 
-void on_mouse_move(int x, int y) {
-    int center_x = glutGet(GLUT_WINDOW_WIDTH) / 2;
-    int center_y = glutGet(GLUT_WINDOW_HEIGHT) / 2;
+#if defined(PIANO_SIMD_X86)
+
+// 4フレームを1命令で処理する。テーブル参照は要素ごとのロードで行う
+SIMD_TARGET_SSE2 void render_voice_sse2(float* mix_buffer, const float* table, double* phase, double phase_increment, float gain, float gain_step, int frame_count) {
+    const int vector_frames = frame_count & ~3;
+    const double start_phase = *phase;
+    const __m128 table_scale = _mm_set1_ps((float)WAVETABLE_SIZE);
+    const __m128 phase_step = _mm_set1_ps((float)(phase_increment * 4.0));
+    const __m128 gain_base = _mm_set1_ps(gain);
+    const __m128 gain_slope = _mm_set1_ps(gain_step);
+    __m128 frame_index = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+    int index[4];
+
+    __m128 lane_phase = _mm_set_ps(
+        (float)wrap_phase(start_phase + phase_increment * 3.0), (float)wrap_phase(start_phase + phase_increment * 2.0),
+        (float)wrap_phase(start_phase + phase_increment), (float)start_phase);
+    lane_phase = _mm_sub_ps(lane_phase, _mm_cvtepi32_ps(_mm_cvttps_epi32(lane_phase)));
+
+    for (int i = 0; i < vector_frames; i += 4) {
+        __m128 table_pos = _mm_mul_ps(lane_phase, table_scale);
+        __m128i table_index = _mm_cvttps_epi32(table_pos);
+        __m128 frac = _mm_sub_ps(table_pos, _mm_cvtepi32_ps(table_index));
+        _mm_storeu_si128((__m128i*)index, table_index);
+
+        __m128 a = _mm_set_ps(table[index[3]], table[index[2]], table[index[1]], table[index[0]]);
+        __m128 b = _mm_set_ps(table[index[3] + 1], table[index[2] + 1], table[index[1] + 1], table[index[0] + 1]);
+        __m128 sample = _mm_add_ps(a, _mm_mul_ps(frac, _mm_sub_ps(b, a)));
+
+        __m128 lane_gain = _mm_add_ps(gain_base, _mm_mul_ps(gain_slope, frame_index));
+        __m128 mix = _mm_add_ps(_mm_loadu_ps(mix_buffer + i), _mm_mul_ps(lane_gain, sample));
+        _mm_storeu_ps(mix_buffer + i, mix);
+        frame_index = _mm_add_ps(frame_index, _mm_set1_ps(4.0f));
+
+        lane_phase = _mm_add_ps(lane_phase, phase_step);
+        lane_phase = _mm_sub_ps(lane_phase, _mm_cvtepi32_ps(_mm_cvttps_epi32(lane_phase)));
+    }
 
-    if (x == center_x && y == center_y) return;
+    // 位相はdoubleで再計算し、float演算の誤差をブロックを越えて蓄積させない
+    *phase = wrap_phase(start_phase + phase_increment * vector_frames);
+    render_voice_scalar(mix_buffer + vector_frames, table, phase, phase_increment,
+        gain + gain_step * (float)vector_frames, gain_step, frame_count - vector_frames);
+}
 
-    float offset_x = (float)(x - center_x) * MOUSE_SENSITIVITY;
-    float offset_y = (float)(center_y - y) * MOUSE_SENSITIVITY;
+// 8フレームを1命令で処理する。テーブル参照はギャザー命令で行う
+SIMD_TARGET_AVX2 void render_voice_avx2(float* mix_buffer, const float* table, double* phase, double phase_increment, float gain, float gain_step, int frame_count) {
+    const int vector_frames = frame_count & ~7;
+    const double start_phase = *phase;
+    const __m256 table_scale = _mm256_set1_ps((float)WAVETABLE_SIZE);
+    const __m256 phase_step = _mm256_set1_ps((float)(phase_increment * 8.0));
+    const __m256 gain_base = _mm256_set1_ps(gain);
+    const __m256 gain_slope = _mm256_set1_ps(gain_step);
+    __m256 frame_index = _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f);
+    float initial_phase[8];
+
+    for (int lane = 0; lane < 8; ++lane) {
+        initial_phase[lane] = (float)wrap_phase(start_phase + phase_increment * lane);
+    }
+    __m256 lane_phase = _mm256_loadu_ps(initial_phase);
+    lane_phase = _mm256_sub_ps(lane_phase, _mm256_cvtepi32_ps(_mm256_cvttps_epi32(lane_phase)));
 
-    g_camera_yaw += offset_x;
-    g_camera_pitch += offset_y;
+    for (int i = 0; i < vector_frames; i += 8) {
+        __m256 table_pos = _mm256_mul_ps(lane_phase, table_scale);
+        __m256i table_index = _mm256_cvttps_epi32(table_pos);
+        __m256 frac = _mm256_sub_ps(table_pos, _mm256_cvtepi32_ps(table_index));
 
-    if (g_camera_pitch > CAMERA_PITCH_MAX) g_camera_pitch = CAMERA_PITCH_MAX;
-    if (g_camera_pitch < CAMERA_PITCH_MIN) g_camera_pitch = CAMERA_PITCH_MIN;
+        __m256 a = _mm256_i32gather_ps(table, table_index, 4);
+        __m256 b = _mm256_i32gather_ps(table + 1, table_index, 4);
+        __m256 sample = _mm256_add_ps(a, _mm256_mul_ps(frac, _mm256_sub_ps(b, a)));
 
-    float rad_yaw = g_camera_yaw * M_PI / 180.0f;
-    float rad_pitch = g_camera_pitch * M_PI / 180.0f;
-    g_camera_front[0] = cos(rad_yaw) * cos(rad_pitch);
-    g_camera_front[1] = sin(rad_pitch);
-    g_camera_front[2] = sin(rad_yaw) * cos(rad_pitch);
+        __m256 lane_gain = _mm256_add_ps(gain_base, _mm256_mul_ps(gain_slope, frame_index));
+        __m256 mix = _mm256_add_ps(_mm256_loadu_ps(mix_buffer + i), _mm256_mul_ps(lane_gain, sample));
+        _mm256_storeu_ps(mix_buffer + i, mix);
+        frame_index = _mm256_add_ps(frame_index, _mm256_set1_ps(8.0f));
 
-    float len = sqrt(pow(g_camera_front[0], 2) + pow(g_camera_front[1], 2) + pow(g_camera_front[2], 2));
-    g_camera_front[0] /= len;
-    g_camera_front[1] /= len;
-    g_camera_front[2] /= len;
+        lane_phase = _mm256_add_ps(lane_phase, phase_step);
+        lane_phase = _mm256_sub_ps(lane_phase, _mm256_cvtepi32_ps(_mm256_cvttps_epi32(lane_phase)));
+    }
 
-    glutWarpPointer(center_x, center_y);
-    glutPostRedisplay();
+    *phase = wrap_phase(start_phase + phase_increment * vector_frames);
+    render_voice_scalar(mix_buffer + vector_frames, table, phase, phase_increment,
+        gain + gain_step * (float)vector_frames, gain_step, frame_count - vector_frames);
 }
 
-void on_menu_select(int menu_id) {
-    switch (menu_id) {
-    case MENU_ID_SEQ_PLAY:
-        if (!g_is_sequencer_playing && g_sequence_length > 0) {
-            g_is_sequencer_playing = 1;
-            g_sequence_index = 0;
-            play_next_sequence_note(0);
-            printf("情報: シーケンスの再生を開始しました。\n");
-        }
-        break;
-    case MENU_ID_SEQ_STOP:
-        if (g_is_sequencer_playing) {
-            g_is_sequencer_playing = 0;
-            play_next_sequence_note(0);
-            printf("情報: シーケンスを停止しました。\n");
-        }
-        break;
+int cpu_supports_avx2() {
+#if defined(_MSC_VER)
+    int cpu_info[4];
+    __cpuid(cpu_info, 0);
+    if (cpu_info[0] < 7) return 0;
+
+    // AVX命令とOSによるYMMレジスタ退避 (OSXSAVE + XCR0) の両方が必要
+    __cpuid(cpu_info, 1);
+    if ((cpu_info[2] & (1 << 27)) == 0 || (cpu_info[2] & (1 << 28)) == 0) return 0;
+    if ((_xgetbv(0) & 0x6) != 0x6) return 0;
+
+    __cpuidex(cpu_info, 7, 0);
+    return (cpu_info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#elif defined(PIANO_SIMD_NEON)
+
+// 4フレームを1命令で処理する。テーブル参照は要素ごとのロードで行う
+void render_voice_neon(float* mix_buffer, const float* table, double* phase, double phase_increment, float gain, float gain_step, int frame_count) {
+    const int vector_frames = frame_count & ~3;
+    const double start_phase = *phase;
+    const float32x4_t phase_step = vdupq_n_f32((float)(phase_increment * 4.0));
+    const float frame_offsets[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    float32x4_t frame_index = vld1q_f32(frame_offsets);
+    float initial_phase[4];
+    int32_t index[4];
+
+    for (int lane = 0; lane < 4; ++lane) {
+        initial_phase[lane] = (float)wrap_phase(start_phase + phase_increment * lane);
+    }
+    float32x4_t lane_phase = vld1q_f32(initial_phase);
+    lane_phase = vsubq_f32(lane_phase, vcvtq_f32_s32(vcvtq_s32_f32(lane_phase)));
+
+    for (int i = 0; i < vector_frames; i += 4) {
+        float32x4_t table_pos = vmulq_n_f32(lane_phase, (float)WAVETABLE_SIZE);
+        int32x4_t table_index = vcvtq_s32_f32(table_pos);
+        float32x4_t frac = vsubq_f32(table_pos, vcvtq_f32_s32(table_index));
+        vst1q_s32(index, table_index);
+
+        float a_values[4] = { table[index[0]], table[index[1]], table[index[2]], table[index[3]] };
+        float b_values[4] = { table[index[0] + 1], table[index[1] + 1], table[index[2] + 1], table[index[3] + 1] };
+        float32x4_t a = vld1q_f32(a_values);
+        float32x4_t sample = vmlaq_f32(a, frac, vsubq_f32(vld1q_f32(b_values), a));
+
+        float32x4_t lane_gain = vmlaq_n_f32(vdupq_n_f32(gain), frame_index, gain_step);
+        vst1q_f32(mix_buffer + i, vmlaq_f32(vld1q_f32(mix_buffer + i), lane_gain, sample));
+        frame_index = vaddq_f32(frame_index, vdupq_n_f32(4.0f));
+
+        lane_phase = vaddq_f32(lane_phase, phase_step);
+        lane_phase = vsubq_f32(lane_phase, vcvtq_f32_s32(vcvtq_s32_f32(lane_phase)));
     }
+
+    *phase = wrap_phase(start_phase + phase_increment * vector_frames);
+    render_voice_scalar(mix_buffer + vector_frames, table, phase, phase_increment,
+        gain + gain_step * (float)vector_frames, gain_step, frame_count - vector_frames);
 }
 
+#endif
+
 
 // ============================================================================
-// アニメーション・シーケンサー
+// シーンオブジェクト・BVH
 // ============================================================================
 
-void update_key_animation(int timer_value) {
-    int needs_redisplay = 0;
+// 重心が最も広がっている軸で中央値分割し、葉が BVH_LEAF_OBJECT_COUNT 個以下になるまで再帰する
+int build_bvh_node(int first_object, int object_count) {
+    if (object_count <= 0 || g_bvh_node_count >= BVH_NODE_MAX) return -1;
+
+    int node_index = g_bvh_node_count++;
+    bvh_node_t* node = &g_bvh_nodes[node_index];
+    node->bbox.min = (vector_3d_t){ 1e9, 1e9, 1e9 };
+    node->bbox.max = (vector_3d_t){ -1e9, -1e9, -1e9 };
+    vector_3d_t centroid_min = { 1e9, 1e9, 1e9 }, centroid_max = { -1e9, -1e9, -1e9 };
+
+    for (int i = first_object; i < first_object + object_count; ++i) {
+        bounding_box_t* box = &g_scene_objects[g_bvh_object_order[i]].world_bbox;
+        node->bbox.min.x = fmin(node->bbox.min.x, box->min.x); node->bbox.max.x = fmax(node->bbox.max.x, box->max.x);
+        node->bbox.min.y = fmin(node->bbox.min.y, box->min.y); node->bbox.max.y = fmax(node->bbox.max.y, box->max.y);
+        node->bbox.min.z = fmin(node->bbox.min.z, box->min.z); node->bbox.max.z = fmax(node->bbox.max.z, box->max.z);
+
+        vector_3d_t centroid = { (box->min.x + box->max.x) * 0.5, (box->min.y + box->max.y) * 0.5, (box->min.z + box->max.z) * 0.5 };
+        centroid_min.x = fmin(centroid_min.x, centroid.x); centroid_max.x = fmax(centroid_max.x, centroid.x);
+        centroid_min.y = fmin(centroid_min.y, centroid.y); centroid_max.y = fmax(centroid_max.y, centroid.y);
+        centroid_min.z = fmin(centroid_min.z, centroid.z); centroid_max.z = fmax(centroid_max.z, centroid.z);
+    }
 
-    for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
-        piano_key_t* key = &g_piano_keys[i];
-        float diff = key->target_y_pos - key->current_y_pos;
+    node->first_object = first_object;
+    node->object_count = object_count;
+    node->left_child = -1;
+    node->right_child = -1;
+    if (object_count <= BVH_LEAF_OBJECT_COUNT) return node_index;
+
+    double extent_x = centroid_max.x - centroid_min.x;
+    double extent_y = centroid_max.y - centroid_min.y;
+    double extent_z = centroid_max.z - centroid_min.z;
+    g_bvh_sort_axis = (extent_x >= extent_y && extent_x >= extent_z) ? 0 : (extent_y >= extent_z ? 1 : 2);
+    qsort(&g_bvh_object_order[first_object], object_count, sizeof(int), compare_scene_objects_on_axis);
+
+    // 再帰で g_bvh_nodes が書き換わるため、子の番号はインデックス経由で格納する
+    int half = object_count / 2;
+    int left_child = build_bvh_node(first_object, half);
+    int right_child = build_bvh_node(first_object + half, object_count - half);
+    g_bvh_nodes[node_index].left_child = left_child;
+    g_bvh_nodes[node_index].right_child = right_child;
+    return node_index;
+}
 
-        if (fabs(diff) > 0.001f) {
-            key->current_y_pos += diff * KEY_ANIMATION_SPEED;
-            needs_redisplay = 1;
+int compare_scene_objects_on_axis(const void* a, const void* b) {
+    const bounding_box_t* box_a = &g_scene_objects[*(const int*)a].world_bbox;
+    const bounding_box_t* box_b = &g_scene_objects[*(const int*)b].world_bbox;
+    double center_a, center_b;
+
+    switch (g_bvh_sort_axis) {
+    case 0:  center_a = box_a->min.x + box_a->max.x; center_b = box_b->min.x + box_b->max.x; break;
+    case 1:  center_a = box_a->min.y + box_a->max.y; center_b = box_b->min.y + box_b->max.y; break;
+    default: center_a = box_a->min.z + box_a->max.z; center_b = box_b->min.z + box_b->max.z; break;
+    }
+    return (center_a > center_b) - (center_a < center_b);
+}
+
+// GPUの深度バッファを読まずに、視線レイと最も手前で交差するオブジェクトをBVHで探す
+pick_result_t pick_object_along_ray(vector_3d_t origin, vector_3d_t direction) {
+    pick_result_t result = { -1, 1e30 };
+    if (g_bvh_node_count == 0) return result;
+
+    vector_3d_t inverse_direction = { 1.0 / direction.x, 1.0 / direction.y, 1.0 / direction.z };
+    int node_stack[BVH_NODE_MAX];
+    int stack_size = 0;
+    node_stack[stack_size++] = 0;
+
+    while (stack_size > 0) {
+        bvh_node_t* node = &g_bvh_nodes[node_stack[--stack_size]];
+        double distance;
+
+        // 既に見つかった交差より遠いノードは調べない
+        if (!intersect_ray_bbox(origin, inverse_direction, node->bbox, &distance) || distance >= result.distance) continue;
+
+        if (node->left_child < 0) {
+            for (int i = node->first_object; i < node->first_object + node->object_count; ++i) {
+                int object_index = g_bvh_object_order[i];
+                if (intersect_ray_bbox(origin, inverse_direction, g_scene_objects[object_index].world_bbox, &distance) && distance < result.distance) {
+                    result.object_index = object_index;
+                    result.distance = distance;
+                }
+            }
         }
         else {
-            key->current_y_pos = key->target_y_pos;
+            node_stack[stack_size++] = node->left_child;
+            node_stack[stack_size++] = node->right_child;
         }
     }
+    return result;
+}
+
+// カメラの位置・向きと画角から視錐台の6平面を求め、BVHを辿って各オブジェクトの表示可否を決める。
+// display() が設定する gluPerspective / gluLookAt と同じ値から作るため、GLから行列を読み戻さない
+void update_scene_visibility() {
+    // gluLookAt と同じく、視線方向 front・右方向 side・上方向 up の正規直交基底を作る
+    double front[3] = { g_camera_front[0], g_camera_front[1], g_camera_front[2] };
+    double side[3] = {
+        front[1] * g_camera_up[2] - front[2] * g_camera_up[1],
+        front[2] * g_camera_up[0] - front[0] * g_camera_up[2],
+        front[0] * g_camera_up[1] - front[1] * g_camera_up[0] };
+    double front_length = sqrt(front[0] * front[0] + front[1] * front[1] + front[2] * front[2]);
+    double side_length = sqrt(side[0] * side[0] + side[1] * side[1] + side[2] * side[2]);
+    if (front_length <= 0.0 || side_length <= 0.0) return;
+    for (int i = 0; i < 3; ++i) {
+        front[i] /= front_length;
+        side[i] /= side_length;
+    }
+    double up[3] = {
+        side[1] * front[2] - side[2] * front[1],
+        side[2] * front[0] - side[0] * front[2],
+        side[0] * front[1] - side[1] * front[0] };
+
+    // 側面の内向き法線は、視線方向に画角の半分の正接を掛けて左右・上下の軸を足し引きしたもの
+    double tan_half_y = tan(CAMERA_FOV_Y_DEG * M_PI / 360.0);
+    double tan_half_x = tan_half_y * g_window_width / g_window_height;
+    double normals[6][3];
+    for (int i = 0; i < 3; ++i) {
+        normals[0][i] = side[i] + tan_half_x * front[i];
+        normals[1][i] = -side[i] + tan_half_x * front[i];
+        normals[2][i] = up[i] + tan_half_y * front[i];
+        normals[3][i] = -up[i] + tan_half_y * front[i];
+        normals[4][i] = front[i];
+        normals[5][i] = -front[i];
+    }
 
-    if (needs_redisplay) {
-        glutPostRedisplay();
+    // 各平面は (a, b, c, d) で、a*x + b*y + c*z + d >= 0 が視錐台の内側。側面はカメラ位置を通る
+    float planes[6][4];
+    for (int p = 0; p < 6; ++p) {
+        double d = -(normals[p][0] * g_camera_pos[0] + normals[p][1] * g_camera_pos[1] + normals[p][2] * g_camera_pos[2]);
+        if (p == 4) d -= CAMERA_NEAR_PLANE;
+        if (p == 5) d += CAMERA_FAR_PLANE;
+        for (int i = 0; i < 3; ++i) planes[p][i] = (float)normals[p][i];
+        planes[p][3] = (float)d;
     }
 
-    glutTimerFunc(ANIMATION_TIMER_MS, update_key_animation, 0);
+    int previous_visibility[SCENE_OBJECT_MAX];
+    memcpy(previous_visibility, g_is_scene_object_visible, sizeof(int) * g_scene_object_count);
+    memset(g_is_scene_object_visible, 0, sizeof(int) * g_scene_object_count);
+    if (g_bvh_node_count > 0) cull_bvh_node(0, planes);
+
+    if (memcmp(previous_visibility, g_is_scene_object_visible, sizeof(int) * g_scene_object_count) != 0) {
+        g_are_key_instances_dirty = 1;
+    }
 }
 
-void play_next_sequence_note(int previous_midi_note) {
-    if (!g_is_sequencer_playing) {
-        for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
-            trigger_note_off(g_piano_keys[i].midi_note);
-        }
-        glutPostRedisplay();
+void cull_bvh_node(int node_index, const float planes[6][4]) {
+    bvh_node_t* node = &g_bvh_nodes[node_index];
+    int classification = classify_bbox_in_frustum(node->bbox, planes);
+
+    if (classification < 0) return;
+    if (classification > 0) {
+        set_bvh_node_visible(node_index);
         return;
     }
 
-    if (g_sequence_index >= g_sequence_length) {
-        trigger_note_off(previous_midi_note);
-        g_is_sequencer_playing = 0;
-        printf("情報: シーケンスの再生が終了しました。\n");
-        glutPostRedisplay();
+    if (node->left_child < 0) {
+        // 葉で視錐台の境界にかかっている場合はオブジェクトごとに判定する
+        for (int i = node->first_object; i < node->first_object + node->object_count; ++i) {
+            int object_index = g_bvh_object_order[i];
+            g_is_scene_object_visible[object_index] = (classify_bbox_in_frustum(g_scene_objects[object_index].world_bbox, planes) >= 0);
+        }
         return;
     }
+    cull_bvh_node(node->left_child, planes);
+    cull_bvh_node(node->right_child, planes);
+}
 
-    sequence_event_t* current_event = &g_sequence[g_sequence_index];
+// 戻り値: -1=完全に外側, 0=境界にかかる, 1=完全に内側
+int classify_bbox_in_frustum(bounding_box_t box, const float planes[6][4]) {
+    int is_fully_inside = 1;
+
+    for (int p = 0; p < 6; ++p) {
+        const float* plane = planes[p];
+        // 平面の法線方向に最も進んだ頂点が外側なら箱全体が外側
+        double far_distance = plane[0] * (plane[0] >= 0 ? box.max.x : box.min.x)
+            + plane[1] * (plane[1] >= 0 ? box.max.y : box.min.y)
+            + plane[2] * (plane[2] >= 0 ? box.max.z : box.min.z) + plane[3];
+        if (far_distance < 0.0) return -1;
+
+        double near_distance = plane[0] * (plane[0] >= 0 ? box.min.x : box.max.x)
+            + plane[1] * (plane[1] >= 0 ? box.min.y : box.max.y)
+            + plane[2] * (plane[2] >= 0 ? box.min.z : box.max.z) + plane[3];
+        if (near_distance < 0.0) is_fully_inside = 0;
+    }
+    return is_fully_inside;
+}
 
-    if (previous_midi_note > 0 && previous_midi_note != current_event->midi_note) {
-        trigger_note_off(previous_midi_note);
+void set_bvh_node_visible(int node_index) {
+    bvh_node_t* node = &g_bvh_nodes[node_index];
+    for (int i = node->first_object; i < node->first_object + node->object_count; ++i) {
+        g_is_scene_object_visible[g_bvh_object_order[i]] = 1;
     }
+}
 
-    trigger_note_on(current_event->midi_note);
+void update_hovered_object() {
+    vector_3d_t origin = { g_camera_pos[0], g_camera_pos[1], g_camera_pos[2] };
+    vector_3d_t direction = { g_camera_front[0], g_camera_front[1], g_camera_front[2] };
+    pick_result_t pick = pick_object_along_ray(origin, direction);
 
-    g_sequence_index++;
-    glutPostRedisplay();
+    if (pick.object_index != g_hovered_scene_object) {
+        g_hovered_scene_object = pick.object_index;
+        g_are_key_instances_dirty = 1;
+        request_redisplay();
+    }
+}
 
-    glutTimerFunc((unsigned int)current_event->duration_ms, play_next_sequence_note, current_event->midi_note);
+int get_scene_object_index(scene_object_type_e type, int index) {
+    return g_scene_object_first[type] + index;
 }
 
 
 // ============================================================================
-// オーディオ処理
+// ユーティリティ
 // ============================================================================
 
-void audio_callback(ma_device* p_device, void* p_output, const void* p_input, ma_uint32 frame_count) {
-    piano_key_t* keys = (piano_key_t*)p_device->pUserData;
-    float* output_buffer = (float*)p_output;
-    (void)p_input;
+float midi_to_freq(int midi_note) {
+    return FREQUENCY_A4 * powf(2.0f, (midi_note - MIDI_NOTE_A4) / 12.0f);
+}
 
-    const double attack_increment = 1.0 / (AUDIO_SAMPLE_RATE * AUDIO_ATTACK_TIME_S);
-    const double release_decrement = 1.0 / (AUDIO_SAMPLE_RATE * AUDIO_RELEASE_TIME_S);
-    timbre_t* current_timbre = &g_timbres[g_current_timbre_index];
+double wrap_phase(double phase) {
+    return phase - floor(phase);
+}
 
-    for (ma_uint32 i = 0; i < frame_count; i++) {
-        double mixed_sample = 0.0;
+const float* get_wavetable_for_note(const timbre_t* timbre, int midi_note) {
+    if (timbre->wavetables == NULL) return NULL;
 
-        for (int k = 0; k < PIANO_KEY_COUNT; ++k) {
-            piano_key_t* key = &keys[k];
-            if (key->envelope_state == ENV_STATE_OFF) continue;
+    int octave = midi_note / 12;
+    if (octave < 0) octave = 0;
+    if (octave >= WAVETABLE_OCTAVE_COUNT) octave = WAVETABLE_OCTAVE_COUNT - 1;
+    return &timbre->wavetables[octave * (WAVETABLE_SIZE + 1)];
+}
 
-            switch (key->envelope_state) {
-            case ENV_STATE_ATTACK:
-                key->current_amplitude += attack_increment;
-                if (key->current_amplitude >= 1.0) {
-                    key->current_amplitude = 1.0;
-                    key->envelope_state = ENV_STATE_PRESSED;
-                }
-                break;
-            case ENV_STATE_RELEASING:
-                key->current_amplitude -= release_decrement;
-                if (key->current_amplitude <= 0.0) {
-                    key->current_amplitude = 0.0;
-                    key->envelope_state = ENV_STATE_OFF;
-                }
-                break;
-            default: break;
-            }
+// Y軸回転 (glRotatef(yaw, 0, 1, 0)) と平行移動を適用した後の8頂点を囲むAABBを求める
+bounding_box_t transform_bbox(bounding_box_t local_bbox, float x, float y, float z, float yaw_degrees) {
+    double rad = yaw_degrees * M_PI / 180.0;
+    double c = cos(rad), s = sin(rad);
+    bounding_box_t world_bbox;
+    world_bbox.min = (vector_3d_t){ 1e9, 1e9, 1e9 };
+    world_bbox.max = (vector_3d_t){ -1e9, -1e9, -1e9 };
+
+    for (int corner = 0; corner < 8; ++corner) {
+        double lx = (corner & 1) ? local_bbox.max.x : local_bbox.min.x;
+        double ly = (corner & 2) ? local_bbox.max.y : local_bbox.min.y;
+        double lz = (corner & 4) ? local_bbox.max.z : local_bbox.min.z;
+        double wx = x + lx * c + lz * s;
+        double wy = y + ly;
+        double wz = z - lx * s + lz * c;
+
+        if (wx < world_bbox.min.x) world_bbox.min.x = wx;
+        if (wx > world_bbox.max.x) world_bbox.max.x = wx;
+        if (wy < world_bbox.min.y) world_bbox.min.y = wy;
+        if (wy > world_bbox.max.y) world_bbox.max.y = wy;
+        if (wz < world_bbox.min.z) world_bbox.min.z = wz;
+        if (wz > world_bbox.max.z) world_bbox.max.z = wz;
+    }
+    return world_bbox;
+}
 
-            if (key->envelope_state != ENV_STATE_OFF) {
-                double frequency = midi_to_freq(key->midi_note + (g_current_octave_shift * 12));
-                double key_sample = 0.0;
+// スラブ法: 各軸で箱に入る/出る距離を求め、区間が重なればカメラ前方で交差している
+int intersect_ray_bbox(vector_3d_t origin, vector_3d_t inverse_direction, bounding_box_t box, double* hit_distance) {
+    double t1 = (box.min.x - origin.x) * inverse_direction.x;
+    double t2 = (box.max.x - origin.x) * inverse_direction.x;
+    double t_near = fmin(t1, t2), t_far = fmax(t1, t2);
+
+    t1 = (box.min.y - origin.y) * inverse_direction.y;
+    t2 = (box.max.y - origin.y) * inverse_direction.y;
+    t_near = fmax(t_near, fmin(t1, t2));
+    t_far = fmin(t_far, fmax(t1, t2));
+
+    t1 = (box.min.z - origin.z) * inverse_direction.z;
+    t2 = (box.max.z - origin.z) * inverse_direction.z;
+    t_near = fmax(t_near, fmin(t1, t2));
+    t_far = fmin(t_far, fmax(t1, t2));
+
+    if (t_far < 0.0 || t_near > t_far) return 0;
+    *hit_distance = (t_near >= 0.0) ? t_near : 0.0;     // カメラが箱の中にある場合は距離0
+    return 1;
+}
 
-                for (int h = 0; h < current_timbre->harmonic_count; ++h) {
-                    harmonic_t* harmonic = &current_timbre->harmonics[h];
-                    double harmonic_freq_multiplier = (double)(h + 1);
-                    key_sample += harmonic->amplitude * sin(key->wave_phase * harmonic_freq_multiplier + harmonic->phase_shift);
-                }
+// 読み取り専用でファイル全体をメモリマップする。空のファイルは失敗として扱う
+int map_file(const char* filename, mapped_file_t* mapped_file) {
+    memset(mapped_file, 0, sizeof(*mapped_file));
+#if defined(_WIN32)
+    HANDLE file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) return 0;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0 || (ma_uint64)file_size.QuadPart > (size_t)-1) {
+        CloseHandle(file_handle);
+        return 0;
+    }
+    HANDLE mapping_handle = CreateFileMappingA(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_handle == NULL) {
+        CloseHandle(file_handle);
+        return 0;
+    }
+    const void* data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL) {
+        CloseHandle(mapping_handle);
+        CloseHandle(file_handle);
+        return 0;
+    }
+    mapped_file->file_handle = file_handle;
+    mapped_file->mapping_handle = mapping_handle;
+    mapped_file->size = (size_t)file_size.QuadPart;
+#else
+    int file_descriptor = open(filename, O_RDONLY);
+    if (file_descriptor < 0) return 0;
+
+    struct stat file_status;
+    if (fstat(file_descriptor, &file_status) != 0 || file_status.st_size <= 0) {
+        close(file_descriptor);
+        return 0;
+    }
+    void* data = mmap(NULL, (size_t)file_status.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    if (data == MAP_FAILED) {
+        close(file_descriptor);
+        return 0;
+    }
+    madvise(data, (size_t)file_status.st_size, MADV_SEQUENTIAL);
+    mapped_file->file_descriptor = file_descriptor;
+    mapped_file->size = (size_t)file_status.st_size;
+#endif
+    mapped_file->data = (const unsigned char*)data;
+    return 1;
+}
 
-                mixed_sample += key->current_amplitude * key_sample;
+void unmap_file(mapped_file_t* mapped_file) {
+    if (mapped_file->data == NULL) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(mapped_file->data);
+    CloseHandle(mapped_file->mapping_handle);
+    CloseHandle(mapped_file->file_handle);
+#else
+    munmap((void*)mapped_file->data, mapped_file->size);
+    close(mapped_file->file_descriptor);
+#endif
+    memset(mapped_file, 0, sizeof(*mapped_file));
+}
 
-                key->wave_phase += 2.0 * M_PI * frequency / AUDIO_SAMPLE_RATE;
-                if (key->wave_phase >= 2.0 * M_PI) {
-                    key->wave_phase -= 2.0 * M_PI;
-                }
-            }
-        }
+int get_cpu_core_count() {
+#if defined(_WIN32)
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return (int)system_info.dwNumberOfProcessors;
+#else
+    long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (core_count > 0) ? (int)core_count : 1;
+#endif
+}
 
-        if (mixed_sample > 1.0) mixed_sample = 1.0;
-        if (mixed_sample < -1.0) mixed_sample = -1.0;
+int get_file_stamp(const char* filename, ma_uint64* size, ma_int64* mtime) {
+#if defined(_WIN32)
+    struct __stat64 file_status;
+    if (_stat64(filename, &file_status) != 0) return 0;
+#else
+    struct stat file_status;
+    if (stat(filename, &file_status) != 0) return 0;
+#endif
+    *size = (ma_uint64)file_status.st_size;
+    *mtime = (ma_int64)file_status.st_mtime;
+    return 1;
+}
 
-        output_buffer[0] = (float)mixed_sample;
-        output_buffer[1] = (float)mixed_sample;
-        output_buffer += 2;
+// FNV-1a (64ビット)
+ma_uint64 hash_bytes(const unsigned char* data, size_t size) {
+    ma_uint64 hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
     }
+    return hash;
 }
 
-void trigger_note_on(int midi_note) {
-    if (midi_note <= 0) return;
+// 要素数が容量を超える場合に容量を2倍ずつ増やす。確保に失敗したら元の配列を残して0を返す
+int grow_array(void** array, int* capacity, int required_count, size_t element_size) {
+    if (required_count <= *capacity) return 1;
+
+    int new_capacity = (*capacity > 0) ? *capacity : 64;
+    while (new_capacity < required_count) new_capacity *= 2;
+    void* new_array = realloc(*array, element_size * (size_t)new_capacity);
+    if (new_array == NULL) return 0;
+    *array = new_array;
+    *capacity = new_capacity;
+    return 1;
+}
 
-    for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
-        if (g_piano_keys[i].midi_note == midi_note) {
-            piano_key_t* key = &g_piano_keys[i];
-            if (key->envelope_state == ENV_STATE_OFF) {
-                key->envelope_state = ENV_STATE_ATTACK;
-                key->current_amplitude = 0.0;
-                key->wave_phase = 0.0;
-            }
-            key->target_y_pos = KEY_PRESSED_Y_OFFSET;
-            return;
-        }
-    }
+const char* skip_spaces(const char* cursor, const char* end) {
+    while (cursor < end && (*cursor == ' ' || *cursor == '\t')) cursor++;
+    return cursor;
 }
 
-void trigger_note_off(int midi_note) {
-    if (midi_note <= 0) return;
+// 10進表記 ([+-]digits[.digits][(e|E)[+-]digits]) を読み取り、続きの位置を返す。数字が無ければ NULL
+const char* scan_float(const char* cursor, const char* end, float* value) {
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    int is_negative = 0;
+    if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+        is_negative = (*cursor == '-');
+        cursor++;
+    }
 
-    for (int i = 0; i < PIANO_KEY_COUNT; ++i) {
-        if (g_piano_keys[i].midi_note == midi_note) {
-            piano_key_t* key = &g_piano_keys[i];
-            if (key->envelope_state == ENV_STATE_ATTACK || key->envelope_state == ENV_STATE_PRESSED) {
-                key->envelope_state = ENV_STATE_RELEASING;
+    // 有効数字は18桁まで整数で蓄積し、それ以降の桁は指数に繰り入れる
+    ma_uint64 mantissa = 0;
+    int exponent = 0;
+    int digit_count = 0;
+    for (; cursor < end && *cursor >= '0' && *cursor <= '9'; ++cursor, ++digit_count) {
+        if (mantissa < 100000000000000000ull) mantissa = mantissa * 10 + (ma_uint64)(*cursor - '0');
+        else exponent++;
+    }
+    if (cursor < end && *cursor == '.') {
+        for (++cursor; cursor < end && *cursor >= '0' && *cursor <= '9'; ++cursor, ++digit_count) {
+            if (mantissa < 100000000000000000ull) {
+                mantissa = mantissa * 10 + (ma_uint64)(*cursor - '0');
+                exponent--;
             }
-            key->target_y_pos = 0.0f;
-            return;
         }
     }
-}
-
-
-// ============================================================================
-// ユーティリティ
-// ============================================================================
+    if (digit_count == 0) return NULL;
+
+    if (cursor < end && (*cursor == 'e' || *cursor == 'E')) {
+        const char* exponent_cursor = cursor + 1;
+        int is_exponent_negative = 0;
+        if (exponent_cursor < end && (*exponent_cursor == '-' || *exponent_cursor == '+')) {
+            is_exponent_negative = (*exponent_cursor == '-');
+            exponent_cursor++;
+        }
+        if (exponent_cursor < end && *exponent_cursor >= '0' && *exponent_cursor <= '9') {
+            int exponent_value = 0;
+            for (; exponent_cursor < end && *exponent_cursor >= '0' && *exponent_cursor <= '9'; ++exponent_cursor) {
+                if (exponent_value < 10000) exponent_value = exponent_value * 10 + (*exponent_cursor - '0');
+            }
+            exponent += is_exponent_negative ? -exponent_value : exponent_value;
+            cursor = exponent_cursor;
+        }
+    }
 
-float midi_to_freq(int midi_note) {
-    return FREQUENCY_A4 * powf(2.0f, (midi_note - MIDI_NOTE_A4) / 12.0f);
+    double result = (double)mantissa;
+    if (result != 0.0) {
+        if (exponent >= 0 && exponent <= 22) result *= powers_of_ten[exponent];
+        else if (exponent < 0 && exponent >= -22) result /= powers_of_ten[-exponent];
+        else result *= pow(10.0, exponent);
+    }
+    *value = (float)(is_negative ? -result : result);
+    return cursor;
 }
 
-vector_3d_t get_world_pos_from_screen_center() {
-    GLdouble modelview[16], projection[16];
-    GLint viewport[4];
-    float win_z;
-    vector_3d_t world_pos;
-
-    glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
-    glGetDoublev(GL_PROJECTION_MATRIX, projection);
-    glGetIntegerv(GL_VIEWPORT, viewport);
-
-    int win_x = viewport[2] / 2;
-    int win_y = viewport[3] / 2;
-
-    glReadPixels(win_x, win_y, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &win_z);
+// [+-]digits を読み取り、続きの位置を返す。数字が無ければ NULL
+const char* scan_int(const char* cursor, const char* end, int* value) {
+    int is_negative = 0;
+    if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+        is_negative = (*cursor == '-');
+        cursor++;
+    }
+    if (cursor >= end || *cursor < '0' || *cursor > '9') return NULL;
 
-    gluUnProject((GLdouble)win_x, (GLdouble)win_y, (GLdouble)win_z,
-        modelview, projection, viewport,
-        &world_pos.x, &world_pos.y, &world_pos.z);
-    return world_pos;
+    int result = 0;
+    for (; cursor < end && *cursor >= '0' && *cursor <= '9'; ++cursor) {
+        if (result < 100000000) result = result * 10 + (*cursor - '0');
+    }
+    *value = is_negative ? -result : result;
+    return cursor;
 }
 
-int is_point_in_box(vector_3d_t point, bounding_box_t box) {
-    return (point.x >= box.min.x && point.x <= box.max.x &&
-        point.y >= box.min.y && point.y <= box.max.y &&
-        point.z >= box.min.z && point.z <= box.max.z);
+// 行末の空白と改行 (CR) を除いた長さ
+size_t trim_line_length(const char* cursor, const char* line_end) {
+    while (line_end > cursor && (line_end[-1] == ' ' || line_end[-1] == '\t' || line_end[-1] == '\r')) line_end--;
+    return (size_t)(line_end - cursor);
 }